@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "cell_arena.h"
+#include "conversion.h"
+#include "hda.h"
+
+// Micro benchmark of the cell filter of the conversion on dense HDAs.
+// Usage: adjacency_bench [nb_cells [nb_queries]]
+// For each dimension d, nb_cells cells of dimension d get d random faces in d0 and d in d1 among
+// nb_cells cells of dimension d - 1 (the faces have them as cofaces, as in the conversion, so the
+// adjacency filter of a face holds about 2d ids and is saturated past a few dimensions). The filter
+// is then run on random pairs of a cell and a face, the candidate being one or the other (start and
+// end lookups), 1 in 8 being adjacent: with the linear scans of the 4 lists, with the adjacency
+// filters of the cells in front of the scans, and as in the conversion, with the adjacency filters
+// in front of cell_list_contains (conversion_filter_cell). "probed" is the share of the pairs not
+// settled by the adjacency filters, whose lists are then looked up.
+
+#define NB_PAIRS 4096
+
+static uint64_t _next(uint64_t* state) {
+    uint64_t x = (*state += 0x9e3779b97f4a7c15ull);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static double _now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static bool _in(struct cell_list* l, cell_id id) {
+    cell_id* ids = cell_list_array(l);
+    for (size_t i = 0; i < l->length; i++) {
+        if (ids[i] == id)
+            return true;
+    }
+    return false;
+}
+
+// the filter without the adjacency filters nor the sets of the lists
+static bool _scan_filter(void* value, void* extra_args) {
+    struct cell* c = value;
+    struct cell* current = extra_args;
+    return !_in(&c->d0, current->id) && !_in(&c->d1, current->id) && !_in(&current->d0, c->id) && !_in(&current->d1, c->id);
+}
+
+// the adjacency filters in front of the scans
+static bool _bloom_scan_filter(void* value, void* extra_args) {
+    return !cell_may_be_adjacent(value, extra_args) || _scan_filter(value, extra_args);
+}
+
+static struct cell* _alloc(struct cell_arena* arena, uint32_t dim, struct id_pool* pool) {
+    struct cell* c = cell_arena_alloc(arena, dim, pool);
+    if (!c) {
+        fprintf(stderr, "not enough memory\n");
+        exit(1);
+    }
+    return c;
+}
+
+// push face in the list l (d0 or d1) of c, a vertex also has the edge in its list of the other side
+static void _link(struct cell* c, struct cell_list* l, struct cell* face, struct id_pool* pool) {
+    if (!cell_list_push(l, face->id, pool) || (!face->dim && !cell_list_push(l == &c->d0 ? &face->d1 : &face->d0, c->id, pool))) {
+        fprintf(stderr, "not enough memory\n");
+        exit(1);
+    }
+    cell_adjacency_add(c, face);
+}
+
+static void _run(size_t n, size_t nb_queries, uint32_t dim) {
+    struct cell_arena* arena = cell_arena_new();
+    struct id_pool* pool = arena ? cell_arena_new_pool(arena) : NULL;
+    struct cell** faces = malloc(n * sizeof(*faces));
+    struct cell** cells = malloc(n * sizeof(*cells));
+    struct cell** currents = malloc(NB_PAIRS * sizeof(*currents));
+    struct cell** candidates = malloc(NB_PAIRS * sizeof(*candidates));
+    if (!pool || !faces || !cells || !currents || !candidates) {
+        fprintf(stderr, "not enough memory\n");
+        exit(1);
+    }
+    uint64_t seed = dim;
+    for (size_t i = 0; i < n; i++)
+        faces[i] = _alloc(arena, dim - 1, pool);
+    for (size_t i = 0; i < n; i++)
+        cells[i] = _alloc(arena, dim, pool);
+    for (size_t i = 0; i < n; i++) {
+        for (uint32_t k = 0; k < dim; k++) {
+            _link(cells[i], &cells[i]->d0, faces[_next(&seed) % n], pool);
+            _link(cells[i], &cells[i]->d1, faces[_next(&seed) % n], pool);
+        }
+    }
+    size_t nb_adjacent = 0;
+    for (size_t i = 0; i < NB_PAIRS; i++) {
+        struct cell* c = cells[_next(&seed) % n];
+        struct cell* face = faces[_next(&seed) % n];
+        if (!(_next(&seed) & 7)) {
+            face = cell_arena_get(arena, cell_list_array(&c->d0)[_next(&seed) % dim]);
+            nb_adjacent++;
+        }
+        candidates[i] = i & 1 ? face : c;
+        currents[i] = i & 1 ? c : face;
+    }
+
+    size_t accepted[3] = { 0 };
+    double times[3];
+    bool (*filters[3])(void*, void*) = { _scan_filter, _bloom_scan_filter, conversion_filter_cell };
+    for (size_t f = 0; f < 3; f++) {
+        double start = _now();
+        for (size_t q = 0; q < nb_queries; q++)
+            accepted[f] += filters[f](candidates[q % NB_PAIRS], currents[q % NB_PAIRS]);
+        times[f] = _now() - start;
+    }
+    size_t nb_probes = 0;
+    for (size_t i = 0; i < NB_PAIRS; i++)
+        nb_probes += cell_may_be_adjacent(candidates[i], currents[i]);
+    if (accepted[0] != accepted[1] || accepted[0] != accepted[2]) {
+        fprintf(stderr, "dimension %u: the filters disagree\n", dim);
+        exit(1);
+    }
+    printf("%3u  %8.1f  %8.1f  %8.1f  %7.1f%%  %7.1f%%\n", dim, 1e9 * times[0] / nb_queries, 1e9 * times[1] / nb_queries,
+           1e9 * times[2] / nb_queries, 100.0 * nb_probes / NB_PAIRS, 100.0 * nb_adjacent / NB_PAIRS);
+    free(candidates);
+    free(currents);
+    free(cells);
+    free(faces);
+    cell_arena_destroy(arena);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 100000;
+    size_t nb_queries = argc > 2 ? strtoull(argv[2], NULL, 10) : 10000000;
+    if (!n || !nb_queries) {
+        fprintf(stderr, "usage: %s [nb_cells [nb_queries]]\n", argv[0]);
+        return 1;
+    }
+    printf("%zu cells per dimension, %zu queries\n", n, nb_queries);
+    printf("dim  scan ns  bloom ns   sets ns   probed  adjacent\n");
+    for (uint32_t dim = 1; dim <= 32; dim *= 2)
+        _run(n, nb_queries, dim);
+    return 0;
+}
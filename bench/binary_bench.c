@@ -0,0 +1,237 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hda.h"
+#include "hda_binary.h"
+#include "logger.h"
+#include "petri_nets.h"
+#include "pnml_generator.h"
+
+// Round trip of the binary format (-O binary): each net is converted and written with and without
+// its cofaces in a temporary file, which is mapped with hda_binary_open; every cell read through the
+// accessors of hda_binary.h is compared with the HDA in memory (dimension, d0, d1, labels, up0,
+// up1). The file must be rejected once truncated, of another version or with a list past its end.
+// Usage: binary_bench [FAMILY:N | FILE.pnml]... (every family with its first default size by default)
+// Prints the write, map and walk times of each net, exits with 1 if a check fails.
+
+static double _now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// false (with a message) if the list of length ids of the cell i (number of the faces in numbers)
+// differs from the k-th elements of the binary list given by get
+static bool _same_list(const char* name, size_t i, const cell_id* ids, size_t length, const size_t* numbers,
+                       const struct hda_binary* b, size_t binary_length, size_t (*get)(const struct hda_binary*, size_t, size_t)) {
+    if (length != binary_length) {
+        fprintf(stderr, "cell %zu: %zu elements in %s instead of %zu\n", i, binary_length, name, length);
+        return false;
+    }
+    for (size_t k = 0; k < length; k++) {
+        if (get(b, i, k) != numbers[ids[k]]) {
+            fprintf(stderr, "cell %zu: element %zu of %s is %zu instead of %zu\n", i, k, name, get(b, i, k), numbers[ids[k]]);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool _same_cells(struct hda* hda, const struct hda_binary* b, const cell_id* order, const size_t* numbers) {
+    size_t nb_cells = cell_arena_length(hda->cells);
+    char** names = hda->labels ? vector_to_array(hda->labels) : NULL;
+    if (hda_binary_nb_cells(b) != nb_cells || hda_binary_has_cofaces(b) != (hda->cofaces != NULL)) {
+        fprintf(stderr, "%zu cells%s instead of %zu%s\n", hda_binary_nb_cells(b), hda_binary_has_cofaces(b) ? " with cofaces" : "",
+                nb_cells, hda->cofaces ? " with cofaces" : "");
+        return false;
+    }
+    for (size_t i = 0; i < nb_cells; i++) {
+        struct cell* c = cell_arena_get(hda->cells, order[i]);
+        if (hda_binary_dim(b, i) != c->dim) {
+            fprintf(stderr, "cell %zu: dimension %zu instead of %u\n", i, hda_binary_dim(b, i), c->dim);
+            return false;
+        }
+        if (!_same_list("d0", i, cell_list_array(&c->d0), c->d0.length, numbers, b, hda_binary_d0_length(b, i), hda_binary_d0)
+            || !_same_list("d1", i, cell_list_array(&c->d1), c->d1.length, numbers, b, hda_binary_d1_length(b, i), hda_binary_d1))
+            return false;
+        if (hda->cofaces
+            && (!_same_list("up0", i, hda_up0(hda->cofaces, order[i]), hda_up0_length(hda->cofaces, order[i]), numbers,
+                            b, hda_binary_up0_length(b, i), hda_binary_up0)
+                || !_same_list("up1", i, hda_up1(hda->cofaces, order[i]), hda_up1_length(hda->cofaces, order[i]), numbers,
+                               b, hda_binary_up1_length(b, i), hda_binary_up1)))
+            return false;
+        const uint32_t* labels = cell_list_array(&c->labels);
+        if (hda_binary_labels_length(b, i) != c->labels.length) {
+            fprintf(stderr, "cell %zu: %zu labels instead of %u\n", i, hda_binary_labels_length(b, i), c->labels.length);
+            return false;
+        }
+        for (size_t k = 0; k < c->labels.length; k++) {
+            if (strcmp(hda_binary_label(b, i, k), names[labels[k]])) {
+                fprintf(stderr, "cell %zu: label %zu is `%s' instead of `%s'\n", i, k, hda_binary_label(b, i, k), names[labels[k]]);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static volatile size_t walk_sum; // keeps the walks
+
+// sum of the elements of every list: the cost of a walk of the mapped HDA
+static size_t _walk(const struct hda_binary* b) {
+    size_t sum = 0;
+    for (size_t i = 0; i < hda_binary_nb_cells(b); i++) {
+        for (size_t k = 0; k < hda_binary_d0_length(b, i); k++)
+            sum += hda_binary_d0(b, i, k);
+        for (size_t k = 0; k < hda_binary_d1_length(b, i); k++)
+            sum += hda_binary_d1(b, i, k);
+        for (size_t k = 0; hda_binary_has_cofaces(b) && k < hda_binary_up0_length(b, i); k++)
+            sum += hda_binary_up0(b, i, k);
+        for (size_t k = 0; hda_binary_has_cofaces(b) && k < hda_binary_up1_length(b, i); k++)
+            sum += hda_binary_up1(b, i, k);
+    }
+    return sum;
+}
+
+// write the 4 bytes value at offset in the file path
+static bool _patch(const char* path, long offset, uint32_t value) {
+    FILE* f = fopen(path, "r+b");
+    bool ok = f && !fseek(f, offset, SEEK_SET) && fwrite(&value, sizeof(value), 1, f) == 1;
+    return f && !fclose(f) && ok;
+}
+
+static bool _rejected(const char* path) {
+    struct hda_binary* b = hda_binary_open(path);
+    hda_binary_close(b);
+    return !b;
+}
+
+// the valid binary HDA of size bytes at path is rejected once truncated, with another version and
+// with its last d0 offset past the end of the file (the file is left invalid)
+static bool _rejects_invalid_files(const char* path, size_t size) {
+    FILE* f = fopen(path, "rb");
+    struct hda_binary_header h;
+    bool ok = f && fread(&h, sizeof(h), 1, f) == 1;
+    if (f)
+        fclose(f);
+    if (!ok)
+        return false;
+    long last_d0 = (long)(h.d0_offsets + h.nb_cells * sizeof(uint64_t));
+    return !truncate(path, (off_t)(size - 8)) && _rejected(path) && !truncate(path, (off_t) size)
+        && _patch(path, offsetof(struct hda_binary_header, version), HDA_BINARY_VERSION + 1) && _rejected(path)
+        && _patch(path, offsetof(struct hda_binary_header, version), HDA_BINARY_VERSION)
+        && _patch(path, last_d0, (uint32_t) size) && _rejected(path);
+}
+
+// write hda in the file path, read it back and compare
+static bool _round_trip(const char* name, struct hda* hda, const char* path) {
+    Vector(cell_id) order_v = hda_output_order(hda);
+    size_t nb_cells = cell_arena_length(hda->cells);
+    size_t* numbers = malloc((nb_cells + 1) * sizeof(*numbers));
+    if (!order_v || !numbers) {
+        fprintf(stderr, "not enough memory\n");
+        exit(1);
+    }
+    cell_id* order = vector_to_array(order_v);
+    for (size_t i = 0; i < nb_cells; i++)
+        numbers[order[i]] = i;
+
+    double start = _now();
+    FILE* out = fopen(path, "wb");
+    bool ok = out && hda_write_binary(hda, out);
+    ok = out && !fclose(out) && ok;
+    double written = _now();
+    struct hda_binary* b = ok ? hda_binary_open(path) : NULL;
+    double mapped = _now();
+    walk_sum = b ? _walk(b) : 0;
+    double walked = _now();
+    ok = b && _same_cells(hda, b, order, numbers);
+    size_t size = b ? b->size : 0;
+    hda_binary_close(b);
+    printf("%-20s %-8s %9zu %11zu %9.3f %9.3f %9.3f  %s\n", name, hda->cofaces ? "yes" : "no", nb_cells, size,
+           1e3 * (written - start), 1e3 * (mapped - written), 1e3 * (walked - mapped), ok ? "ok" : "FAILED");
+    if (ok && !_rejects_invalid_files(path, size)) {
+        fprintf(stderr, "%s: an invalid file was accepted\n", name);
+        ok = false;
+    }
+    vector_destroy(order_v);
+    free(numbers);
+    return ok;
+}
+
+static bool _check_net(const char* name, const char* net_path, const char* path) {
+    struct petri_net* net = parse_pnml_file(net_path);
+    if (!net) {
+        fprintf(stderr, "cannot parse `%s'\n", net_path);
+        return false;
+    }
+    struct hda* hda = conversion(net, (struct conversion_options){ .nb_threads = 1 });
+    bool ok = _round_trip(name, hda, path);
+    if (!hda_build_cofaces(hda, 1)) {
+        fprintf(stderr, "not enough memory\n");
+        exit(1);
+    }
+    ok = _round_trip(name, hda, path) && ok;
+    free_hda(hda, true);
+    petri_net_destroy(net);
+    return ok;
+}
+
+// FAMILY:N (generated in a temporary file) or a pnml file
+static bool _check_spec(const char* spec, const char* path) {
+    const char* colon = strchr(spec, ':');
+    if (!colon)
+        return _check_net(spec, spec, path);
+    const struct pnml_family* family = NULL;
+    for (const struct pnml_family* f = pnml_families; f->name && !family; f++) {
+        if (strlen(f->name) == (size_t)(colon - spec) && !strncmp(f->name, spec, (size_t)(colon - spec)))
+            family = f;
+    }
+    char* rest = NULL;
+    size_t n = strtoull(colon + 1, &rest, 10);
+    if (!family || rest == colon + 1 || *rest || n < family->min_size) {
+        fprintf(stderr, "invalid net `%s'\n", spec);
+        return false;
+    }
+    char net_path[] = "/tmp/pn2hda_binaryXXXXXX";
+    int fd = mkstemp(net_path);
+    FILE* net = fd >= 0 ? fdopen(fd, "w") : NULL;
+    bool ok = net && pnml_generate(net, family, n);
+    ok = net && !fclose(net) && ok;
+    if (!net && fd >= 0)
+        close(fd);
+    ok = ok && _check_net(spec, net_path, path);
+    if (fd >= 0)
+        unlink(net_path);
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    // the invalid files are expected to be rejected with an error
+    logger_set_options((struct logger_options){ .output_logs = false, .min_level = FATAL });
+    char path[] = "/tmp/pn2hda_binaryXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr, "cannot create a temporary file\n");
+        return 1;
+    }
+    close(fd);
+    printf("%-20s %-8s %9s %11s %9s %9s %9s\n", "net", "cofaces", "cells", "bytes", "write ms", "map ms", "walk ms");
+    bool ok = true;
+    if (argc == 1) {
+        for (const struct pnml_family* f = pnml_families; f->name; f++) {
+            char spec[64];
+            snprintf(spec, sizeof(spec), "%s:%zu", f->name, f->default_sizes[0]);
+            ok = _check_spec(spec, path) && ok;
+        }
+    }
+    for (int i = 1; i < argc; i++)
+        ok = _check_spec(argv[i], path) && ok;
+    unlink(path);
+    return ok ? 0 : 1;
+}
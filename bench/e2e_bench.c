@@ -0,0 +1,233 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE // wait4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hda.h"
+#include "logger.h"
+#include "petri_nets.h"
+#include "pnml_generator.h"
+
+// End to end benchmark: parse, convert and print (in /dev/null) the nets of the generated families.
+// Usage: e2e_bench [-j THREADS] [-t SECONDS] [-o FILE] [FAMILY[:N,N...]]... (THREADS print the HDA)
+// Every family with its default sizes by default. Each net runs in its own process so that its peak
+// resident memory is its own. The results are written in JSON (on the standard output by default):
+//     { "threads": ..., "time_limit": ..., "runs": [ { "family", "size", "places", "transitions",
+//       "status", "parse_s", "convert_s", "print_s", "wall_s", "cells", "cells_per_s",
+//       "peak_rss_kb", "cells_per_dim": [...] }, ... ] }
+// "status" is "complete", "time_limit", "memory_limit" (partial HDA) or "error".
+
+#define MAX_DIMS 64
+
+// sent by the process of a run to the harness
+struct _result {
+    bool ok;
+    enum conversion_status status;
+    size_t nb_places;
+    size_t nb_transitions;
+    double parse, convert, print;
+    size_t nb_cells;
+    size_t nb_dims;
+    size_t cells_per_dim[MAX_DIMS]; // the last one counts the cells of dimension >= MAX_DIMS - 1
+};
+
+static double _now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void _measure(const char* path, struct conversion_options options, struct _result* r) {
+    double start = _now();
+    struct petri_net* net = parse_pnml_file(path);
+    double parsed = _now();
+    if (!net)
+        return;
+    r->nb_places = vector_length(net->marking);
+    r->nb_transitions = vector_length(net->transitions);
+    struct hda* hda = conversion(net, options);
+    double converted = _now();
+    FILE* null = fopen("/dev/null", "w");
+    if (!null)
+        return;
+    print_hda_parallel(hda, null, options.nb_threads);
+    fclose(null);
+    double printed = _now();
+
+    r->nb_cells = cell_arena_length(hda->cells);
+    for (size_t id = 0; id < r->nb_cells; id++) {
+        size_t d = cell_arena_get(hda->cells, id)->dim;
+        d = d < MAX_DIMS ? d : MAX_DIMS - 1;
+        r->cells_per_dim[d]++;
+        r->nb_dims = d + 1 > r->nb_dims ? d + 1 : r->nb_dims;
+    }
+    r->status = hda->status;
+    r->parse = parsed - start;
+    r->convert = converted - parsed;
+    r->print = printed - converted;
+    r->ok = true;
+    free_hda(hda, true);
+    petri_net_destroy(net);
+}
+
+// run the net of path in a child process: return its peak resident memory in KB
+static long _run(const char* path, struct conversion_options options, struct _result* r) {
+    *r = (struct _result){ .ok = false };
+    int fds[2];
+    if (pipe(fds))
+        return 0;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    if (!pid) {
+        close(fds[0]);
+        _measure(path, options, r);
+        ssize_t written = write(fds[1], r, sizeof(*r));
+        _exit(written != sizeof(*r));
+    }
+    close(fds[1]);
+    size_t length = 0;
+    for (ssize_t n; length < sizeof(*r) && (n = read(fds[0], (char*) r + length, sizeof(*r) - length)) > 0; )
+        length += (size_t) n;
+    close(fds[0]);
+    int status;
+    struct rusage usage = { 0 };
+    wait4(pid, &status, 0, &usage);
+    if (length != sizeof(*r) || !WIFEXITED(status) || WEXITSTATUS(status))
+        r->ok = false;
+    return usage.ru_maxrss;
+}
+
+static const char* _status_name(struct _result* r) {
+    if (!r->ok)
+        return "error";
+    switch (r->status) {
+        case CONVERSION_TIME_LIMIT: return "time_limit";
+        case CONVERSION_MEMORY_LIMIT: return "memory_limit";
+        default: return "complete";
+    }
+}
+
+static bool _bench(FILE* out, const struct pnml_family* family, size_t n, struct conversion_options options, bool* first) {
+    char path[] = "/tmp/pn2hda_benchXXXXXX";
+    int fd = mkstemp(path);
+    FILE* net = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!net) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(path);
+        }
+        fprintf(stderr, "cannot create a temporary file\n");
+        return false;
+    }
+    bool ok = pnml_generate(net, family, n);
+    ok = !fclose(net) && ok;
+    if (!ok) {
+        unlink(path);
+        fprintf(stderr, "unable to write the net %s %zu\n", family->name, n);
+        return false;
+    }
+    struct _result r;
+    double start = _now();
+    long peak = _run(path, options, &r);
+    double wall = _now() - start;
+    unlink(path);
+    fprintf(stderr, "%s %zu: %s, %zu cells in %.3f s\n", family->name, n, _status_name(&r), r.nb_cells, wall);
+
+    fprintf(out, "%s\n    { \"family\": \"%s\", \"size\": %zu, \"places\": %zu, \"transitions\": %zu, \"status\": \"%s\",\n",
+            *first ? "" : ",", family->name, n, r.nb_places, r.nb_transitions, _status_name(&r));
+    fprintf(out, "      \"parse_s\": %.6f, \"convert_s\": %.6f, \"print_s\": %.6f, \"wall_s\": %.6f,\n",
+            r.parse, r.convert, r.print, wall);
+    fprintf(out, "      \"cells\": %zu, \"cells_per_s\": %.1f, \"peak_rss_kb\": %ld, \"cells_per_dim\": [",
+            r.nb_cells, r.convert > 0 ? r.nb_cells / r.convert : 0., peak);
+    for (size_t d = 0; d < r.nb_dims; d++)
+        fprintf(out, "%s%zu", d ? ", " : "", r.cells_per_dim[d]);
+    fprintf(out, "] }");
+    *first = false;
+    return true;
+}
+
+// FAMILY or FAMILY:N,N...
+static bool _bench_spec(FILE* out, const char* spec, struct conversion_options options, bool* first) {
+    const char* colon = strchr(spec, ':');
+    size_t length = colon ? (size_t)(colon - spec) : strlen(spec);
+    const struct pnml_family* family = NULL;
+    for (const struct pnml_family* f = pnml_families; f->name && !family; f++) {
+        if (strlen(f->name) == length && !strncmp(f->name, spec, length))
+            family = f;
+    }
+    if (!family) {
+        fprintf(stderr, "unknown family `%.*s'\n", (int) length, spec);
+        return false;
+    }
+    if (!colon) {
+        for (const size_t* n = family->default_sizes; *n; n++) {
+            if (!_bench(out, family, *n, options, first))
+                return false;
+        }
+        return true;
+    }
+    for (const char* s = colon + 1; *s; ) {
+        char* rest = NULL;
+        size_t n = strtoull(s, &rest, 10);
+        if (rest == s || (*rest && *rest != ',') || n < family->min_size) {
+            fprintf(stderr, "invalid size in `%s' (at least %zu)\n", spec, family->min_size);
+            return false;
+        }
+        if (!_bench(out, family, n, options, first))
+            return false;
+        s = *rest ? rest + 1 : rest;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    struct conversion_options options = { .nb_threads = 1, .checkpoint_interval = 300 };
+    const char* output = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:t:o:")) != -1) {
+        switch (opt) {
+            case 'j':
+                options.nb_threads = strtoull(optarg, NULL, 10);
+                break;
+            case 't':
+                options.time_limit = strtod(optarg, NULL);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-j THREADS] [-t SECONDS] [-o FILE] [FAMILY[:N,N...]]...\n", argv[0]);
+                return 1;
+        }
+    }
+    if (!options.nb_threads)
+        options.nb_threads = 1;
+    logger_set_options((struct logger_options){ .output_logs = false });
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "cannot open `%s'\n", output);
+        return 1;
+    }
+    fprintf(out, "{ \"threads\": %zu, \"time_limit\": %g, \"runs\": [", options.nb_threads, options.time_limit);
+    bool ok = true, first = true;
+    if (optind == argc) {
+        for (const struct pnml_family* f = pnml_families; ok && f->name; f++)
+            ok = _bench_spec(out, f->name, options, &first);
+    }
+    for (int i = optind; ok && i < argc; i++)
+        ok = _bench_spec(out, argv[i], options, &first);
+    fprintf(out, "\n] }\n");
+    ok = !(output && fclose(out)) && ok;
+    return !ok;
+}
@@ -0,0 +1,147 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hashtbl.h"
+#include "marking.h"
+
+// Micro benchmark of hashtbl on the workload of the conversion: a visited set of markings.
+// Usage: hashtbl_bench [nb_markings [nb_places]]
+// Every marking is first looked up then added (as the exploration does), then every marking is
+// looked up again (hits) as well as as many absent markings (misses). Keys are either pointers to
+// the markings or inline (hash, marking) pairs, which compare the hashes without dereferencing.
+// The worst insertion time is measured over batches of BATCH insertions: it shows the resizes
+// (which the incremental mode spreads over the next calls).
+
+#define BATCH 64
+
+enum _mode { MODE_POINTER, MODE_INLINE, MODE_INCREMENTAL };
+
+struct _inline_key {
+    size_t hash;
+    const struct marking* marking;
+};
+
+static size_t _inline_hash(const void* key) {
+    return ((const struct _inline_key*) key)->hash;
+}
+
+static size_t _inline_cmp(const void* k1, const void* k2) {
+    const struct _inline_key* a = k1;
+    const struct _inline_key* b = k2;
+    return a->hash != b->hash || marking_cmp(a->marking, b->marking);
+}
+
+static uint64_t _next(uint64_t* state) {
+    uint64_t x = (*state += 0x9e3779b97f4a7c15ull);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static double _now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// random markings with counters in [min, min + 4)
+static struct marking** _markings(struct marking_arena* arena, struct marking* scratch, size_t n, uint64_t seed, unsigned min) {
+    struct marking** markings = malloc(n * sizeof(*markings));
+    if (!markings) return NULL;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t p = 0; p < scratch->nb_places; p++)
+            scratch->counters[p] = (unsigned char)(min + (_next(&seed) & 3));
+        marking_rehash(scratch);
+        if (!(markings[i] = marking_arena_commit(arena, scratch))) {
+            free(markings);
+            return NULL;
+        }
+    }
+    return markings;
+}
+
+static void* _key(bool inline_keys, struct _inline_key* tmp, const struct marking* m) {
+    if (!inline_keys)
+        return (void*) m;
+    *tmp = (struct _inline_key){ .hash = m->hash, .marking = m };
+    return tmp;
+}
+
+static void _run(enum _mode mode, struct marking** present, struct marking** absent, size_t n) {
+    Hashtbl(struct marking*, size_t) h;
+    bool inline_keys = mode != MODE_POINTER;
+    if (inline_keys) {
+        HASHTBL_NEW(h, struct _inline_key, size_t, .hash_func = _inline_hash, .cmp_func = _inline_cmp, .inline_keys = true, .incremental = mode == MODE_INCREMENTAL);
+    } else {
+        HASHTBL_NEW(h, struct marking*, size_t, .hash_func = marking_hash, .cmp_func = marking_cmp);
+    }
+    if (!h) {
+        fprintf(stderr, "not enough memory\n");
+        exit(1);
+    }
+    const char* names[] = { "pointer", "inline", "incremental" };
+    struct _inline_key tmp;
+    size_t found = 0;
+
+    double start = _now(), worst = 0;
+    for (size_t b = 0; b < n; b += BATCH) {
+        double batch = _now();
+        for (size_t i = b; i < n && i < b + BATCH; i++) {
+            void* key = _key(inline_keys, &tmp, present[i]);
+            if (hashtbl_find(h, key).value)
+                found++;
+            else if (!hashtbl_add(h, key, (void*)(i + 1), false)) {
+                fprintf(stderr, "not enough memory\n");
+                exit(1);
+            }
+        }
+        batch = _now() - batch;
+        if (batch > worst) worst = batch;
+    }
+    double insert = _now() - start;
+
+    start = _now();
+    for (size_t i = 0; i < n; i++)
+        found += hashtbl_find(h, _key(inline_keys, &tmp, present[(i * 0x9e3779b1u) % n])).value != NULL;
+    double hit = _now() - start;
+
+    start = _now();
+    for (size_t i = 0; i < n; i++)
+        found += hashtbl_find(h, _key(inline_keys, &tmp, absent[i])).value != NULL;
+    double miss = _now() - start;
+
+    printf("%-11s insert %7.1f ns/op (worst %d: %8.1f us)  hit %7.1f ns/op  miss %7.1f ns/op  (%zu)\n",
+           names[mode], 1e9 * insert / n, BATCH, 1e6 * worst, 1e9 * hit / n, 1e9 * miss / n, found);
+    hashtbl_destroy(h);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    uint32_t nb_places = argc > 2 ? (uint32_t) strtoul(argv[2], NULL, 10) : 64;
+    if (!n || !nb_places) {
+        fprintf(stderr, "usage: %s [nb_markings [nb_places]]\n", argv[0]);
+        return 1;
+    }
+    struct marking_arena* arena = marking_arena_new(nb_places, 1);
+    struct marking* scratch = arena ? marking_scratch_new(arena) : NULL;
+    struct marking** present = scratch ? _markings(arena, scratch, n, 1, 0) : NULL;
+    // no counter of a present marking is above 3
+    struct marking** absent = present ? _markings(arena, scratch, n, 2, 4) : NULL;
+    if (!absent) {
+        fprintf(stderr, "not enough memory\n");
+        return 1;
+    }
+    printf("%zu markings of %u places\n", n, nb_places);
+    _run(MODE_POINTER, present, absent, n);
+    _run(MODE_INLINE, present, absent, n);
+    _run(MODE_INCREMENTAL, present, absent, n);
+    free(present);
+    free(absent);
+    free(scratch);
+    marking_arena_destroy(arena);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hashtbl_concurrent.h"
+#include "marking.h"
+
+// Scaling benchmark of hashtbl_concurrent as a shared visited set of markings.
+// Usage: hashtbl_concurrent_bench [nb_markings [max_threads]]
+// With 1, 2, 4, ... max_threads threads (the number of cores by default), every marking is added
+// if absent by two threads: half of the calls insert, the other half find. The same run with a
+// single stripe is the baseline of one global lock.
+
+#define NB_STRIPES 1024
+
+struct _thread {
+    pthread_t thread;
+    struct hashtbl_concurrent* h;
+    struct marking** markings;
+    size_t n;
+    size_t first;
+    size_t nb_calls;
+    size_t nb_added;
+};
+
+static uint64_t _next(uint64_t* state) {
+    uint64_t x = (*state += 0x9e3779b97f4a7c15ull);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+static double _now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void* _run_thread(void* args) {
+    struct _thread* t = args;
+    for (size_t k = 0; k < t->nb_calls; k++) {
+        struct marking* m = t->markings[(t->first + k) % t->n];
+        struct hashtbl_element e = hashtbl_concurrent_add_if_absent(t->h, m, m);
+        if (e.value == ERROR_PTR) {
+            fprintf(stderr, "not enough memory\n");
+            exit(1);
+        }
+        t->nb_added += !e.value;
+    }
+    return NULL;
+}
+
+// return the number of calls per second
+static double _run(struct marking** markings, size_t n, size_t nb_threads, size_t nb_stripes) {
+    HashtblConcurrent(struct marking*, struct marking*) h;
+    HASHTBL_CONCURRENT_NEW(h, nb_stripes, struct marking*, struct marking*, .hash_func = marking_hash, .cmp_func = marking_cmp, .incremental = true);
+    struct _thread* threads = calloc(nb_threads, sizeof(*threads));
+    if (!h || !threads) {
+        fprintf(stderr, "not enough memory\n");
+        exit(1);
+    }
+    double start = _now();
+    for (size_t i = 0; i < nb_threads; i++) {
+        // the ranges of two consecutive threads overlap on half of their markings
+        threads[i] = (struct _thread){ .h = h, .markings = markings, .n = n, .first = i * n / nb_threads, .nb_calls = 2 * n / nb_threads };
+        if (pthread_create(&threads[i].thread, NULL, _run_thread, &threads[i])) {
+            fprintf(stderr, "unable to start thread %zu\n", i);
+            exit(1);
+        }
+    }
+    size_t nb_calls = 0, nb_added = 0;
+    for (size_t i = 0; i < nb_threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        nb_calls += threads[i].nb_calls;
+        nb_added += threads[i].nb_added;
+    }
+    double elapsed = _now() - start;
+    if (nb_added != n)
+        fprintf(stderr, "%zu markings added instead of %zu\n", nb_added, n);
+    free(threads);
+    hashtbl_concurrent_destroy(h);
+    return nb_calls / elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    long nb_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = argc > 2 ? strtoull(argv[2], NULL, 10) : nb_cores > 0 ? (size_t) nb_cores : 1;
+    if (!n || !max_threads) {
+        fprintf(stderr, "usage: %s [nb_markings [max_threads]]\n", argv[0]);
+        return 1;
+    }
+    uint32_t nb_places = 64;
+    struct marking_arena* arena = marking_arena_new(nb_places, 1);
+    struct marking* scratch = arena ? marking_scratch_new(arena) : NULL;
+    struct marking** markings = malloc(n * sizeof(*markings));
+    if (!scratch || !markings) {
+        fprintf(stderr, "not enough memory\n");
+        return 1;
+    }
+    uint64_t seed = 1;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t p = 0; p < nb_places; p++)
+            scratch->counters[p] = (unsigned char)(_next(&seed) & 3);
+        marking_rehash(scratch);
+        if (!(markings[i] = marking_arena_commit(arena, scratch))) {
+            fprintf(stderr, "not enough memory\n");
+            return 1;
+        }
+    }
+    printf("%zu markings, %ld cores\n", n, nb_cores);
+    printf("threads  %d stripes (Mcalls/s)  1 stripe (Mcalls/s)\n", NB_STRIPES);
+    for (size_t t = 1; ; t = 2 * t < max_threads ? 2 * t : max_threads) {
+        double striped = _run(markings, n, t, NB_STRIPES);
+        double global = _run(markings, n, t, 1);
+        printf("%7zu  %20.2f  %19.2f\n", t, striped / 1e6, global / 1e6);
+        if (t == max_threads)
+            break;
+    }
+    free(markings);
+    free(scratch);
+    marking_arena_destroy(arena);
+    return 0;
+}
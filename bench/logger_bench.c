@@ -0,0 +1,78 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+// Throughput of LOG(INFO) written in a log file (not on the terminal) by 1, 2, 4, ... threads.
+// Usage: logger_bench [nb_logs [max_threads [log_file]]] (/dev/null by default)
+
+struct _thread {
+    pthread_t thread;
+    size_t id;
+    size_t nb_logs;
+};
+
+static double _now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void* _run_thread(void* args) {
+    struct _thread* t = args;
+    for (size_t i = 0; i < t->nb_logs; i++)
+        LOG(INFO, "thread %zu: %zu cells, %zu unexplored, marking `%s'", t->id, i, t->nb_logs - i, "p0 p1 p2");
+    return NULL;
+}
+
+// return the number of logs per second (including the time to write them)
+static double _run(size_t n, size_t nb_threads) {
+    struct _thread* threads = calloc(nb_threads, sizeof(*threads));
+    if (!threads) {
+        fprintf(stderr, "not enough memory\n");
+        exit(1);
+    }
+    double start = _now();
+    for (size_t i = 0; i < nb_threads; i++) {
+        threads[i] = (struct _thread){ .id = i, .nb_logs = n / nb_threads };
+        if (pthread_create(&threads[i].thread, NULL, _run_thread, &threads[i])) {
+            fprintf(stderr, "unable to start thread %zu\n", i);
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < nb_threads; i++)
+        pthread_join(threads[i].thread, NULL);
+    logger_flush();
+    double elapsed = _now() - start;
+    free(threads);
+    return n / nb_threads * nb_threads / elapsed;
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    long nb_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t max_threads = argc > 2 ? strtoull(argv[2], NULL, 10) : nb_cores > 0 ? (size_t) nb_cores : 1;
+    const char* file = argc > 3 ? argv[3] : "/dev/null";
+    if (!n || !max_threads) {
+        fprintf(stderr, "usage: %s [nb_logs [max_threads [log_file]]]\n", argv[0]);
+        return 1;
+    }
+    logger_set_options((struct logger_options){ .output_logs = false });
+    if (!logger_set_outfile(file)) {
+        fprintf(stderr, "cannot open `%s'\n", file);
+        return 1;
+    }
+    printf("%zu logs, %ld cores\n", n, nb_cores);
+    printf("threads  Mlogs/s\n");
+    for (size_t t = 1; ; t = 2 * t < max_threads ? 2 * t : max_threads) {
+        printf("%7zu  %7.2f\n", t, _run(n, t) / 1e6);
+        if (t == max_threads)
+            break;
+    }
+    logger_close_outfile();
+    return 0;
+}
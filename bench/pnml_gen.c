@@ -0,0 +1,37 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pnml_generator.h"
+
+// Write a net of a generated family in PNML.
+// Usage: pnml_gen FAMILY N [FILE] (standard output by default)
+
+static void _usage(const char* program) {
+    fprintf(stderr, "usage: %s FAMILY N [FILE]\nfamilies:\n", program);
+    for (const struct pnml_family* f = pnml_families; f->name; f++)
+        fprintf(stderr, "  %-16s %s (N >= %zu)\n", f->name, f->description, f->min_size);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3 || argc > 4) {
+        _usage(argv[0]);
+        return 1;
+    }
+    const struct pnml_family* family = pnml_family_find(argv[1]);
+    char* rest = NULL;
+    size_t n = strtoull(argv[2], &rest, 10);
+    if (!family || *rest || n < family->min_size) {
+        _usage(argv[0]);
+        return 1;
+    }
+    FILE* out = argc == 4 ? fopen(argv[3], "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "cannot open `%s'\n", argv[3]);
+        return 1;
+    }
+    bool ok = pnml_generate(out, family, n);
+    ok = !fclose(out) && ok;
+    if (!ok)
+        fprintf(stderr, "unable to write the net\n");
+    return !ok;
+}
@@ -0,0 +1,168 @@
+#include "pnml_generator.h"
+
+#include <string.h>
+
+// length of the chain of the autoconcurrency family
+#define AUTO_LENGTH 2
+
+static void _place(FILE* out, const char* id, size_t tokens) {
+    if (tokens)
+        fprintf(out, "\t<place id=\"%s\"><initialMarking><text>%zu</text></initialMarking></place>\n", id, tokens);
+    else
+        fprintf(out, "\t<place id=\"%s\"/>\n", id);
+}
+
+static void _transition(FILE* out, const char* id, const char* label) {
+    fprintf(out, "\t<transition id=\"%s\"><name><text>%s</text></name></transition>\n", id, label);
+}
+
+static void _arc(FILE* out, size_t* nb_arcs, const char* source, const char* target) {
+    fprintf(out, "\t<arc id=\"a%zu\" source=\"%s\" target=\"%s\"/>\n", (*nb_arcs)++, source, target);
+}
+
+// n chains p_i_0 -a-> p_i_1 -b-> p_i_2 (the labels are shared by the processes)
+static void _parallel(FILE* out, size_t n) {
+    char p[64], q[64], t[64];
+    size_t nb_arcs = 0;
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < 3; j++) {
+            snprintf(p, sizeof(p), "p%zu_%zu", i, j);
+            _place(out, p, !j);
+        }
+        for (size_t j = 0; j < 2; j++) {
+            snprintf(t, sizeof(t), "t%zu_%zu", i, j);
+            _transition(out, t, j ? "b" : "a");
+            snprintf(p, sizeof(p), "p%zu_%zu", i, j);
+            snprintf(q, sizeof(q), "p%zu_%zu", i, j + 1);
+            _arc(out, &nb_arcs, p, t);
+            _arc(out, &nb_arcs, t, q);
+        }
+    }
+}
+
+// Nets with cycles are unfolded by the conversion (their HDA grows with the time limit): in the
+// families below every process runs once.
+
+// philosopher i thinks (t_i), takes its forks f_i and f_(i+1) at once, eats (e_i), releases them
+// and is done (d_i)
+static void _philosophers(FILE* out, size_t n) {
+    char think[64], eat[64], done[64], fork[64], next[64], take[64], release[64], label[64];
+    size_t nb_arcs = 0;
+    for (size_t i = 0; i < n; i++) {
+        snprintf(think, sizeof(think), "t%zu", i);
+        snprintf(fork, sizeof(fork), "f%zu", i);
+        snprintf(eat, sizeof(eat), "e%zu", i);
+        snprintf(done, sizeof(done), "d%zu", i);
+        _place(out, think, 1);
+        _place(out, fork, 1);
+        _place(out, eat, 0);
+        _place(out, done, 0);
+    }
+    for (size_t i = 0; i < n; i++) {
+        snprintf(think, sizeof(think), "t%zu", i);
+        snprintf(fork, sizeof(fork), "f%zu", i);
+        snprintf(next, sizeof(next), "f%zu", (i + 1) % n);
+        snprintf(eat, sizeof(eat), "e%zu", i);
+        snprintf(done, sizeof(done), "d%zu", i);
+        snprintf(take, sizeof(take), "T%zu", i);
+        snprintf(release, sizeof(release), "R%zu", i);
+        snprintf(label, sizeof(label), "take%zu", i);
+        _transition(out, take, label);
+        snprintf(label, sizeof(label), "release%zu", i);
+        _transition(out, release, label);
+        _arc(out, &nb_arcs, think, take);
+        _arc(out, &nb_arcs, fork, take);
+        _arc(out, &nb_arcs, next, take);
+        _arc(out, &nb_arcs, take, eat);
+        _arc(out, &nb_arcs, eat, release);
+        _arc(out, &nb_arcs, release, done);
+        _arc(out, &nb_arcs, release, fork);
+        _arc(out, &nb_arcs, release, next);
+    }
+}
+
+// station i produces an item (P_i) from its stock (S_i) in the buffer B_i of the next station,
+// which consumes it (C_i) once it has produced its own item (W_i: waiting) and is done (D_i)
+static void _ring(FILE* out, size_t n) {
+    char stock[64], waiting[64], done[64], buffer[64], produce[64], consume[64], label[64];
+    size_t nb_arcs = 0;
+    for (size_t i = 0; i < n; i++) {
+        snprintf(stock, sizeof(stock), "S%zu", i);
+        snprintf(waiting, sizeof(waiting), "W%zu", i);
+        snprintf(done, sizeof(done), "D%zu", i);
+        snprintf(buffer, sizeof(buffer), "B%zu", i);
+        _place(out, stock, 1);
+        _place(out, waiting, 0);
+        _place(out, done, 0);
+        _place(out, buffer, 0);
+    }
+    for (size_t i = 0; i < n; i++) {
+        snprintf(stock, sizeof(stock), "S%zu", i);
+        snprintf(waiting, sizeof(waiting), "W%zu", i);
+        snprintf(done, sizeof(done), "D%zu", i);
+        snprintf(buffer, sizeof(buffer), "B%zu", (i + 1) % n);
+        snprintf(produce, sizeof(produce), "P%zu", i);
+        snprintf(label, sizeof(label), "produce%zu", i);
+        _transition(out, produce, label);
+        _arc(out, &nb_arcs, stock, produce);
+        _arc(out, &nb_arcs, produce, buffer);
+        _arc(out, &nb_arcs, produce, waiting);
+        snprintf(buffer, sizeof(buffer), "B%zu", i);
+        snprintf(consume, sizeof(consume), "C%zu", i);
+        snprintf(label, sizeof(label), "consume%zu", i);
+        _transition(out, consume, label);
+        _arc(out, &nb_arcs, waiting, consume);
+        _arc(out, &nb_arcs, buffer, consume);
+        _arc(out, &nb_arcs, consume, done);
+    }
+}
+
+// n tokens in p0 of the chain p0 -x0-> p1 -x1-> ... p_AUTO_LENGTH
+static void _autoconcurrency(FILE* out, size_t n) {
+    char p[64], q[64], t[64];
+    size_t nb_arcs = 0;
+    for (size_t j = 0; j <= AUTO_LENGTH; j++) {
+        snprintf(p, sizeof(p), "p%zu", j);
+        _place(out, p, j ? 0 : n);
+    }
+    for (size_t j = 0; j < AUTO_LENGTH; j++) {
+        snprintf(t, sizeof(t), "t%zu", j);
+        snprintf(q, sizeof(q), "x%zu", j);
+        _transition(out, t, q);
+        snprintf(p, sizeof(p), "p%zu", j);
+        snprintf(q, sizeof(q), "p%zu", j + 1);
+        _arc(out, &nb_arcs, p, t);
+        _arc(out, &nb_arcs, t, q);
+    }
+}
+
+static const size_t _parallel_sizes[] = { 4, 5, 6, 0 };
+static const size_t _philosophers_sizes[] = { 5, 6, 7, 0 };
+static const size_t _ring_sizes[] = { 4, 5, 6, 0 };
+static const size_t _autoconcurrency_sizes[] = { 4, 5, 6, 0 };
+
+const struct pnml_family pnml_families[] = {
+    { "parallel", "n independent processes of two steps a then b", 1, _parallel_sizes, _parallel },
+    { "philosophers", "n dining philosophers taking both forks at once, eating once", 2, _philosophers_sizes, _philosophers },
+    { "ring", "ring of n producer/consumer stations, each one sending one item to the next", 2, _ring_sizes, _ring },
+    { "autoconcurrency", "n tokens along a chain of 2 transitions (a transition fires n times at once)", 1, _autoconcurrency_sizes, _autoconcurrency },
+    { NULL, NULL, 0, NULL, NULL },
+};
+
+const struct pnml_family* pnml_family_find(const char* name) {
+    for (const struct pnml_family* f = pnml_families; f->name; f++) {
+        if (!strcmp(f->name, name))
+            return f;
+    }
+    return NULL;
+}
+
+bool pnml_generate(FILE* out, const struct pnml_family* family, size_t n) {
+    fprintf(out, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                 "<pnml xmlns=\"http://www.pnml.org/version-2009/grammar/pnml\">\n"
+                 "<net id=\"%s%zu\" type=\"http://www.pnml.org/version-2009/grammar/ptnet\">\n"
+                 "<page id=\"page\">\n", family->name, n);
+    family->write_nodes(out, n);
+    fprintf(out, "</page>\n</net>\n</pnml>\n");
+    return !ferror(out);
+}
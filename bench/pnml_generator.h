@@ -0,0 +1,24 @@
+#ifndef PNML_GENERATOR_H
+#define PNML_GENERATOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Parameterised families of bounded P/T nets, written in PNML, whose HDA grows with the size n
+struct pnml_family {
+    const char* name;
+    const char* description; // meaning of n
+    size_t min_size;
+    const size_t* default_sizes; // sizes of the end to end benchmark (0 terminated)
+    void (*write_nodes)(FILE* out, size_t n); // places, transitions and arcs of the page
+};
+
+// the families, terminated by an entry of NULL name
+extern const struct pnml_family pnml_families[];
+
+const struct pnml_family* pnml_family_find(const char* name);
+// write the net of the family of size n (>= min_size) in out: return false on a write error
+bool pnml_generate(FILE* out, const struct pnml_family* family, size_t n);
+
+#endif // PNML_GENERATOR_H
@@ -0,0 +1,29 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "hda.h"
+#include "vector.h"
+
+// Batch mode: every net of every input file is converted, one output file per net.
+// The nets are converted at the same time by a pool of threads (each conversion is sequential),
+// the files are parsed by the threads of the pool as well.
+// The output of the net of input `dir/name.pnml` is `name.hda` (resp. `name.hdab` in binary) in
+// output_dir (dir if NULL), or `name.<net id>.hda` if the file contains several nets.
+
+struct batch_options {
+    size_t nb_threads; // size of the pool
+    const char* output_dir; // NULL: next to each input
+    bool binary; // output format (see hda_binary.h)
+    bool cofaces; // the cofaces of the cells are written (see hda_build_cofaces)
+    struct conversion_options conversion; // options of each conversion (nb_threads and writer are ignored)
+};
+
+// the non empty lines of the file at path which do not start with '#' (NULL if it cannot be read)
+Vector(char*) batch_read_list(const char* path);
+// convert the nets of the nb_files files: return the number of files or nets which failed
+size_t batch_convert(const char* const* files, size_t nb_files, struct batch_options options);
+
+#endif // BATCH_H
@@ -0,0 +1,65 @@
+#ifndef CELL_ARENA_H
+#define CELL_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// index of a cell in its cell_arena
+typedef uint32_t cell_id;
+
+#define CELL_LIST_INLINE 2
+
+// Small array of 32-bit ids (cells or labels): up to CELL_LIST_INLINE ids are stored inline,
+// longer lists live in an id_pool. Vertices and edges have at most two faces on each side.
+struct cell_list {
+    uint32_t length;
+    uint32_t capacity;
+    union {
+        uint32_t inline_ids[CELL_LIST_INLINE];
+        uint32_t* ids;
+    } data;
+};
+
+static inline uint32_t* cell_list_array(struct cell_list* l) {
+    return l->capacity > CELL_LIST_INLINE ? l->data.ids : l->data.inline_ids;
+}
+
+struct cell;
+struct cell_arena;
+// bump allocator of the lists longer than CELL_LIST_INLINE (only usable by one thread at a time)
+struct id_pool;
+
+bool cell_list_reserve(struct cell_list* l, uint32_t capacity, struct id_pool* pool);
+bool cell_list_push(struct cell_list* l, uint32_t id, struct id_pool* pool);
+
+// A list of capacity > CELL_LIST_SCAN_MAX is followed in the pool by an open addressing set of its
+// ids (linear probing, 2 to 4 slots per id), filled by cell_list_push.
+#define CELL_LIST_SCAN_MAX 8
+bool cell_list_set_contains(struct cell_list* l, uint32_t id); // lists of capacity > CELL_LIST_SCAN_MAX
+// whether id is in l in O(1): a scan of at most CELL_LIST_SCAN_MAX ids or a lookup in the set of
+// the list (which must have been filled with cell_list_push)
+static inline bool cell_list_contains(struct cell_list* l, uint32_t id) {
+    if (l->capacity > CELL_LIST_SCAN_MAX)
+        return cell_list_set_contains(l, id);
+    uint32_t* ids = cell_list_array(l);
+    for (uint32_t i = 0; i < l->length; i++) {
+        if (ids[i] == id)
+            return true;
+    }
+    return false;
+}
+
+// Cells are allocated in slabs and released all together with the arena.
+// cell_arena_alloc and cell_arena_new_pool can be called concurrently.
+struct cell_arena* cell_arena_new(void);
+void cell_arena_destroy(struct cell_arena* arena);
+struct id_pool* cell_arena_new_pool(struct cell_arena* arena);
+// new cell of dimension dim (with room for dim ids in d0, d1 and labels), NULL if not enough memory
+struct cell* cell_arena_alloc(struct cell_arena* arena, uint32_t dim, struct id_pool* pool);
+size_t cell_arena_length(struct cell_arena* arena);
+struct cell* cell_arena_get(struct cell_arena* arena, cell_id id);
+// one byte of flags per cell for the users of the arena (0 when the cell is allocated)
+uint8_t* cell_arena_flags(struct cell_arena* arena, cell_id id);
+
+#endif // CELL_ARENA_H
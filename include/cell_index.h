@@ -0,0 +1,37 @@
+#ifndef CELL_INDEX_H
+#define CELL_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "hda.h"
+#include "marking.h"
+
+// Visited cells of the conversion indexed by (marking, labels multiset).
+// All the cells sharing a key are kept in their insertion order, so a lookup only runs the
+// (adjacency) filter on the cells that already have the right marking and labels.
+
+struct cell_key {
+    const struct marking* marking;
+    const uint32_t* labels; // sorted label ids
+    size_t nb_labels;
+    size_t signature; // cell_labels_signature of labels
+};
+
+struct cell_index;
+
+size_t cell_key_hash(const struct cell_key* key);
+
+struct cell_index* cell_index_new(void);
+void cell_index_destroy(struct cell_index* index);
+// first cell (in insertion order) with the given key accepted by the filter, NULL if none
+// to_d0: the caller adds a cell to the d0 of the cell found, so the cells whose d0 is full (dim
+// faces, 2 incoming edges for a vertex) are skipped without calling the filter, and once met they
+// are left out of the next lookups on d0 of their key
+struct cell* cell_index_find(struct cell_index* index, const struct cell_key* key, bool to_d0, bool (*filter)(void* cell, void* extra_args), void* extra_args);
+// add c with the marking m (the key is built from the labels of c, which must not change anymore)
+bool cell_index_add(struct cell_index* index, const struct marking* m, struct cell* c);
+// call func on every cell of the index with its marking (in no particular order)
+void cell_index_forall(struct cell_index* index, void (*func)(const struct marking* m, struct cell* c, void* args), void* args);
+
+#endif // CELL_INDEX_H
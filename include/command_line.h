@@ -2,6 +2,7 @@
 #define COMMAND_LINE_H
 
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef union { bool is_set; const char* value; } arg_default_value;
 
@@ -11,5 +12,8 @@ bool parse_command_line(int argc, char **args);
 void display_help(const char* header);
 bool is_flag_set(const char* name);
 const char* get_argument_value(const char* name);
+// arguments which are not options nor option values, in the command line order
+size_t get_nb_positional_arguments(void);
+const char* get_positional_argument(size_t i);
 
 #endif // COMMAND_LINE_H
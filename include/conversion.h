@@ -0,0 +1,122 @@
+#ifndef CONVERSION_H
+#define CONVERSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "hda.h"
+#include "marking.h"
+#include "vector.h"
+
+// Internal pieces of the exploration (convert.c) shared with the checkpoints (checkpoint.c)
+
+// stacks of activated transitions and sorted label ids of a cell: as long as its dimension
+VECTOR_DEFINE(transition_stack, size_t, 8)
+VECTOR_DEFINE(label_list, uint32_t, 8)
+
+// heap allocated copy of stack without its skip-th transition (SIZE_MAX: none), exit if not enough memory
+struct transition_stack* conversion_stack_copy(struct transition_stack* stack, size_t skip);
+void conversion_stack_free(struct transition_stack* stack);
+
+// whether the cell reached from current by starting (is_d0) or ending a transition can be a known
+// one: a vertex already started by two edges only reaches new ones
+static inline bool conversion_may_reuse(const struct cell* current, bool is_d0) {
+    return current->dim || !is_d0 || current->d1.length < 2;
+}
+// filter for cell_index_find: the found cell (with the right marking and labels) can be reused from
+// the current cell (extra_args)
+bool conversion_filter_cell(void* value, void* extra_args);
+// write in labels the sorted label ids of the transitions in transition_stack and return their signature
+size_t conversion_labels(struct vector* pn, struct transition_stack* transition_stack, struct label_list* labels);
+// create a cell of dimension |labels| started from S or terminated from T
+// (lists longer than CELL_LIST_INLINE are allocated from pool)
+struct cell* conversion_new_cell(struct cell_arena* arena, struct id_pool* pool, struct label_list* labels, size_t signature, struct cell* S, struct cell* T);
+// link an already known cell c1 reached by starting (resp. ending) a transition from c
+void conversion_link_started(struct cell* c, struct cell* c1, struct id_pool* pool);
+void conversion_link_ended(struct cell* c, struct cell* c1, struct id_pool* pool);
+
+// copy m in the arena (exit if not enough memory)
+struct marking* conversion_commit_marking(struct marking_arena* arena, const struct marking* m);
+// initial marking of pn committed in the arena (scratch is used as temporary)
+struct marking* conversion_initial_marking(struct petri_net* pn, struct marking_arena* arena, struct marking* scratch);
+
+// streaming output (see conversion_options.writer): flags of a cell in cell_arena_flags
+#define CONVERSION_CELL_DONE 1 // successors computed: d1 is final
+#define CONVERSION_CELL_STREAMED 2 // handed to the writer
+// mark c as done (if done) and return true if c must be handed to the writer now:
+// it is done and its d0 is full (vertices are not printed with their boundaries)
+bool conversion_stream_ready(struct cell_arena* arena, struct cell* c, bool done);
+// hand to the writer every cell not streamed yet (end of the exploration)
+void conversion_stream_rest(struct cell_arena* arena, struct hda_writer* writer);
+
+// time and memory budgets of an exploration (see conversion_options): the clock and the
+// memory are only read every CONVERSION_BUDGET_PERIOD steps
+#define CONVERSION_BUDGET_PERIOD 1024
+struct conversion_budget {
+    struct timespec deadline;
+    bool has_deadline;
+    size_t memory_limit; // bytes, 0: no limit
+    size_t memory_base; // resident memory of the process when the budget was initialized
+    size_t steps;
+};
+void conversion_budget_init(struct conversion_budget* b, struct conversion_options options);
+enum conversion_status conversion_budget_read(struct conversion_budget* b);
+// count one step: return the budget reached (CONVERSION_COMPLETE if the exploration can go on)
+static inline enum conversion_status conversion_budget_step(struct conversion_budget* b) {
+    if (++b->steps % CONVERSION_BUDGET_PERIOD || (!b->has_deadline && !b->memory_limit))
+        return CONVERSION_COMPLETE;
+    return conversion_budget_read(b);
+}
+// log the reason why the exploration stops
+void conversion_budget_log(enum conversion_status status, struct conversion_options options);
+
+// Exploration (convert.c): one pending `_conversion' call: the cell being explored and where its loops stopped
+struct _frame {
+    struct marking* m; // marking of the cell (owned by the marking arena)
+    struct transition_stack* transition_stack; // stack of activated transition
+    struct cell* c;
+    size_t enabled; // offset of the enabled transitions of m in the enabled stack
+    size_t nb_enabled;
+    size_t i; // enabled transition currently started
+    size_t j; // number of instances of enabled transition i already started
+    size_t k; // transition of the stack currently ended
+    struct transition_stack* copy; // transition stack without the k-th transition (end phase only)
+    enum { FRAME_START, FRAME_END } phase;
+};
+VECTOR_DEFINE(frame_list, struct _frame, 16)
+
+struct _conversion_state {
+    struct petri_net* net;
+    struct vector* pn; // transition part
+    struct hda* hda;
+    struct hda_writer* writer; // streaming output (NULL if none)
+    size_t dim_bound; // see conversion_options
+    struct conversion_budget budget;
+    // snapshots of the exploration (path NULL if none), written every checkpoint_interval seconds
+    const char* checkpoint;
+    double checkpoint_interval;
+    struct timespec next_checkpoint;
+    struct cell_index* visited; // (marking, labels) -> cells
+    struct id_pool* pool; // boundaries longer than CELL_LIST_INLINE
+    struct marking_arena* arena;
+    struct marking* scratch; // successor being probed
+    struct label_list labels; // sorted label ids of the successor being probed
+    size_t signature; // signature of labels
+    struct marking_consumers* consumers; // place -> transitions consuming from it
+    struct enabled_list enabled; // enabled transitions of the frames (one slice per frame)
+    struct enabled_list next; // enabled transitions of the successor being entered
+    struct index_list touched; // temporary of marking_enabled_update
+    struct frame_list frames;
+};
+
+// Checkpoints of the exploration (checkpoint.c): the snapshot holds the cells with their
+// markings and flags, the frames, the enabled transitions of the frames and the root transition
+// stack (the other stacks are the copies of the frames in their end phase).
+// write the snapshot of the exploration in path (through a temporary file renamed at the end)
+bool conversion_checkpoint_write(struct _conversion_state* state, struct petri_net* pn, const char* path);
+// load the snapshot at path in the state of a new exploration of pn (nothing explored yet),
+// the root transition stack in t_stack
+bool conversion_checkpoint_read(struct _conversion_state* state, struct petri_net* pn, const char* path, struct transition_stack* t_stack);
+
+#endif // CONVERSION_H
@@ -12,6 +12,13 @@ _Pragma("GCC diagnostic ignored \"-Woverride-init\"") \
     OUT = hashtbl_new(sizeof(TYPE_KEY), sizeof(TYPE_VALUE), &(struct hashtbl_creation_args){ .capacity = 256, .hash_func = hashtbl_default_hashfunc, .cmp_func = hashtbl_default_cmpfunc, __VA_ARGS__ }); \
 _Pragma("GCC diagnostic pop")
 
+// Open addressing hash table (see src/utils/hashtbl.c). Values are pointers.
+// Keys are pointers as well, unless inline_keys is set: the sizeof_key bytes at key are then
+// copied in the table, hash_func and cmp_func get pointers to those bytes and the keys returned
+// point in the table (they are valid until the next call on the table).
+// In incremental mode a resize moves the elements a few at a time on the next calls instead of
+// all at once, so no call takes time proportional to the size of the table.
+// The functions given to hashtbl_forall must not call the other functions on the table.
 struct hashtbl;
 
 struct hashtbl_element {
@@ -23,6 +30,8 @@ struct hashtbl_creation_args {
     size_t capacity;
     size_t (*hash_func)(const void* key);
     size_t (*cmp_func)(const void* key1, const void* key2);
+    bool inline_keys;
+    bool incremental;
 };
 
 size_t hashtbl_default_cmpfunc(const void* key1, const void* key2);
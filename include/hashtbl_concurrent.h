@@ -0,0 +1,42 @@
+#ifndef HASHTBL_CONCURRENT_H
+#define HASHTBL_CONCURRENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "hashtbl.h"
+
+#define HashtblConcurrent(T1, T2) struct hashtbl_concurrent*
+#define HASHTBL_CONCURRENT_NEW(OUT, NB_STRIPES, TYPE_KEY, TYPE_VALUE, ...) \
+_Pragma("GCC diagnostic push") \
+_Pragma("GCC diagnostic ignored \"-Woverride-init\"") \
+    OUT = hashtbl_concurrent_new(NB_STRIPES, sizeof(TYPE_KEY), sizeof(TYPE_VALUE), &(struct hashtbl_creation_args){ .capacity = 256, .hash_func = hashtbl_default_hashfunc, .cmp_func = hashtbl_default_cmpfunc, __VA_ARGS__ }); \
+_Pragma("GCC diagnostic pop")
+
+// Hash table shared by threads: the keys are split in stripes (by their hash), each one a hashtbl
+// protected by its own lock, so threads only wait for each other on keys of the same stripe.
+// find and add_if_absent take the lock of the stripe of the key. A sequence of operations which
+// must be atomic (e.g. a lookup then an update of the value found) locks the stripe itself and
+// works on its table. Once the lock is released, only the values returned can be used (the keys
+// returned point in the table if they are inline).
+struct hashtbl_concurrent;
+
+// nb_stripes is rounded up to a power of 2, the capacity of the creation args is the one of each stripe
+struct hashtbl_concurrent* hashtbl_concurrent_new(size_t nb_stripes, size_t sizeof_key, size_t sizeof_value, struct hashtbl_creation_args* extra_args);
+void hashtbl_concurrent_destroy(struct hashtbl_concurrent* h);
+
+struct hashtbl_element hashtbl_concurrent_find(struct hashtbl_concurrent* h, void* key);
+// add key if no equal key is in the table: return the element found ({ NULL, NULL } if key is
+// added, { ERROR_PTR, ERROR_PTR } if it cannot be)
+struct hashtbl_element hashtbl_concurrent_add_if_absent(struct hashtbl_concurrent* h, void* key, void* value);
+
+size_t hashtbl_concurrent_stripe(struct hashtbl_concurrent* h, const void* key);
+void hashtbl_concurrent_lock(struct hashtbl_concurrent* h, size_t stripe);
+void hashtbl_concurrent_unlock(struct hashtbl_concurrent* h, size_t stripe);
+// table of the stripe: to be used with its lock held
+struct hashtbl* hashtbl_concurrent_table(struct hashtbl_concurrent* h, size_t stripe);
+
+// every element of every stripe (no other thread may use the table meanwhile)
+void hashtbl_concurrent_forall(struct hashtbl_concurrent* h, void (*func)(struct hashtbl_element elm, void* args), void* extra_args);
+
+#endif // HASHTBL_CONCURRENT_H
@@ -1,40 +1,138 @@
 #ifndef HDA_H
 #define HDA_H
 
+#include <stdint.h>
+
 #include "vector.h"
 #include "pair.h"
 #include "petri_nets.h"
+#include "cell_arena.h"
 
 struct cell {
-    size_t dim;
-    Vector(struct cell*) d0; // Pair(struct cell*, char*) unstart label P.snd
-    Vector(struct cell*) d1; // Pair(struct cell*, char*) finished label P.snd
-    Vector(char*) labels;
-    // Vector(Pair(struct cell*, char*)) up; //<< d+1 cells reachable from current with label P.snd starting
+    cell_id id; // index of the cell in hda.cells
+    uint32_t dim;
+    size_t signature; // hash of the labels multiset (see cell_labels_signature)
+    struct cell_list d0; // cell_id: unstart faces (incoming edges of a vertex)
+    struct cell_list d1; // cell_id: finished faces (outgoing edges of a vertex)
+    struct cell_list labels; // sorted label ids (see hda.labels)
+    uint64_t adjacency; // bloom filter of the ids of the cells of dimension dim - 1 in its d0/d1
+};
+
+// Cofaces of the cells (the up relation) as CSR arrays indexed by cell id: the cells of dimension
+// d + 1 having the cell c in their d0 (reached from c by starting a transition, whose label is the
+// one missing in c) are up0[up0_offsets[c] .. up0_offsets[c + 1]), sorted by id, and the ones
+// having c in their d1 are in up1 likewise. The up0 (resp. up1) of a vertex is its d1 (resp. d0).
+struct hda_cofaces {
+    size_t nb_cells;
+    size_t* up0_offsets; // nb_cells + 1 offsets
+    cell_id* up0;
+    size_t* up1_offsets;
+    cell_id* up1;
 };
 
-/*
-cell->up is simple do create at the end of the hda:
-for each c in hda->cells:
-    for each d in c->d0:
-        let l <- diff c->labels | d->labels // or d.snd if Pair
-        add(c, l) in d->up // or in (d.fst)->up if Pair
-    done
-done
-*/
+static inline size_t hda_up0_length(const struct hda_cofaces* up, cell_id c) {
+    return up->up0_offsets[c + 1] - up->up0_offsets[c];
+}
+
+static inline const cell_id* hda_up0(const struct hda_cofaces* up, cell_id c) {
+    return up->up0 + up->up0_offsets[c];
+}
+
+static inline size_t hda_up1_length(const struct hda_cofaces* up, cell_id c) {
+    return up->up1_offsets[c + 1] - up->up1_offsets[c];
+}
+
+static inline const cell_id* hda_up1(const struct hda_cofaces* up, cell_id c) {
+    return up->up1 + up->up1_offsets[c];
+}
+
+// why the exploration ended: the HDA is partial unless it is CONVERSION_COMPLETE
+enum conversion_status {
+    CONVERSION_COMPLETE,
+    CONVERSION_TIME_LIMIT,
+    CONVERSION_MEMORY_LIMIT,
+};
 
 struct hda {
-    Vector(struct cell*) cells;
-    Vector(struct cell*) initial;
-    Vector(struct cell*) final;
+    struct cell_arena* cells;
+    Vector(cell_id) initial;
+    Vector(cell_id) final;
+    Vector(char*) labels; // label names indexed by label id (owned by the petri net)
+    enum conversion_status status;
+    size_t nb_unexplored; // frontier of a partial HDA: cells whose successors are not all computed
+    struct hda_cofaces* cofaces; // NULL until hda_build_cofaces
 };
 
-void free_cell(struct cell* c);
-struct cell* init_cell(size_t dim);
+struct hda_writer;
+
+struct conversion_options {
+    size_t nb_threads; // threads of the steps after the exploration (output, cofaces), which is sequential
+    struct hda_writer* writer; // if not NULL, every cell is handed to it as soon as its boundaries are final
+    // only the cells of dimension < dim_bound are built (0: no bound): no transition is started
+    // in a cell of dimension dim_bound - 1, the lower cells keep all their boundaries
+    size_t dim_bound;
+    // budgets (0: no limit): once one is reached the exploration stops and the HDA is partial
+    double time_limit; // seconds
+    size_t memory_limit; // bytes of resident memory gained by the process since the conversion started
+    // snapshot of the exploration written in checkpoint (if not NULL)
+    // every checkpoint_interval seconds and when a budget is reached, resumed from resume (if not NULL)
+    const char* checkpoint;
+    double checkpoint_interval;
+    const char* resume;
+};
+
+// bits of id in the adjacency filter of a cell (2 bits of 64)
+static inline uint64_t cell_adjacency_bits(cell_id id) {
+    uint64_t h = (uint64_t) id * 0x9e3779b97f4a7c15ull;
+    return (1ull << (h >> 58)) | (1ull << ((h >> 52) & 63));
+}
+
+// record that a is in d0 or d1 of b (or the converse): linked cells have dimensions d and d + 1 and
+// the one of dimension d + 1 always has the other in its lists (a vertex and an edge are in the
+// lists of each other), so only its filter holds the other
+static inline void cell_adjacency_add(struct cell* a, struct cell* b) {
+    if (a->dim > b->dim)
+        a->adjacency |= cell_adjacency_bits(b->id);
+    else
+        b->adjacency |= cell_adjacency_bits(a->id);
+}
+
+// false if a and b are not linked, true if they may be (then the lists of the higher one tell)
+static inline bool cell_may_be_adjacent(const struct cell* a, const struct cell* b) {
+    const struct cell* higher = a->dim > b->dim ? a : b;
+    uint64_t bits = cell_adjacency_bits((higher == a ? b : a)->id);
+    return (higher->adjacency & bits) == bits;
+}
+
+// order independent hash of a multiset of label ids
+size_t cell_labels_signature(const uint32_t* labels, size_t nb_labels);
 void free_hda(struct hda* hda, bool free_content);
 struct hda* init_hda(void);
+// build hda->cofaces from d0 and d1 of the cells of dimension >= 1 with nb_threads threads: each
+// thread counts then fills the lists of chunks of cells (false if not enough memory)
+bool hda_build_cofaces(struct hda* hda, size_t nb_threads);
+void hda_free_cofaces(struct hda* hda);
 void print_hda(struct hda* hda, FILE* out);
+// same output, the text of the cells is formatted by nb_threads threads
+void print_hda_parallel(struct hda* hda, FILE* out, size_t nb_threads);
+// ids of the cells in output order: sorted by dimension, then by id (NULL if not enough memory)
+Vector(cell_id) hda_output_order(struct hda* hda);
+
+// Text of the cells as printed by print_hda
+struct cell_formatter {
+    char** names; // label names
+    size_t* name_lengths;
+    const size_t* numbers; // output number of each cell id (faces are numbered by their id if NULL)
+    const struct hda_cofaces* cofaces; // if not NULL, the up0 and up1 lists follow d0 and d1
+};
+
+bool cell_formatter_init(struct cell_formatter* f, struct vector* labels, const size_t* numbers);
+void cell_formatter_destroy(struct cell_formatter* f);
+// upper bound of the number of bytes written by cell_formatter_write for c
+size_t cell_formatter_bound(const struct cell_formatter* f, struct cell* c);
+// write the text of cell c numbered number in buf (not NUL terminated) and return its length
+size_t cell_formatter_write(const struct cell_formatter* f, char* buf, struct cell* c, size_t number);
 
-struct hda* conversion(struct petri_net* pn);
+struct hda* conversion(struct petri_net* pn, struct conversion_options options);
 
 #endif // HDA_H
@@ -0,0 +1,142 @@
+#ifndef HDA_BINARY_H
+#define HDA_BINARY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "hda.h"
+
+// Binary HDA format (`-O binary`), designed to be mmap'ed and used in place.
+// Every section starts on an 8 bytes boundary, integers are in the byte order of the writer
+// (see byte_order). Cells are numbered by dimension as in the text output: the cells of
+// dimension d are [dims[d], dims[d+1]). The faces of cell i are d0[d0_offsets[i]..d0_offsets[i+1]]
+// (resp. d1), stored on index_width bytes; its labels are label ids (uint32_t) in
+// labels[labels_offsets[i]..labels_offsets[i+1]], the name of label l is the NUL terminated
+// string at label_strings + label_names[l]. If the HDA was written with its cofaces (see
+// hda_build_cofaces), up0 and up1 are stored like d0 and d1, otherwise their offsets are 0.
+
+#define HDA_BINARY_MAGIC "PN2HDA\0B"
+#define HDA_BINARY_VERSION 2
+#define HDA_BINARY_BYTE_ORDER 0x01020304u
+
+struct hda_binary_header {
+    char magic[8]; // HDA_BINARY_MAGIC
+    uint32_t version; // HDA_BINARY_VERSION
+    uint32_t byte_order; // HDA_BINARY_BYTE_ORDER as written by the producer
+    uint32_t index_width; // size of a cell index in d0 and d1: 4 or 8 bytes
+    uint32_t reserved;
+    uint64_t nb_cells;
+    uint64_t nb_dims; // highest dimension + 1
+    uint64_t nb_labels;
+    uint64_t file_size;
+    // offsets of the sections from the beginning of the file
+    uint64_t dims; // uint64_t[nb_dims + 1]
+    uint64_t d0_offsets; // uint64_t[nb_cells + 1]
+    uint64_t d0; // index_width bytes[d0_offsets[nb_cells]]
+    uint64_t d1_offsets; // uint64_t[nb_cells + 1]
+    uint64_t d1; // index_width bytes[d1_offsets[nb_cells]]
+    uint64_t labels_offsets; // uint64_t[nb_cells + 1]
+    uint64_t labels; // uint32_t[labels_offsets[nb_cells]]
+    uint64_t label_names; // uint64_t[nb_labels]: offsets in label_strings
+    uint64_t label_strings; // char[]
+    uint64_t up0_offsets; // uint64_t[nb_cells + 1]
+    uint64_t up0; // index_width bytes[up0_offsets[nb_cells]]
+    uint64_t up1_offsets; // uint64_t[nb_cells + 1]
+    uint64_t up1; // index_width bytes[up1_offsets[nb_cells]]
+};
+
+// write hda (with its cofaces if they are built) in out: return false if an error occurred
+bool hda_write_binary(struct hda* hda, FILE* out);
+
+// A binary HDA mapped in memory: the arrays point inside the mapping
+struct hda_binary {
+    const struct hda_binary_header* header;
+    const uint64_t* dims;
+    const uint64_t* d0_offsets;
+    const void* d0;
+    const uint64_t* d1_offsets;
+    const void* d1;
+    const uint64_t* labels_offsets;
+    const uint32_t* labels;
+    const uint64_t* label_names;
+    const char* label_strings;
+    const uint64_t* up0_offsets; // NULL if the file has no cofaces
+    const void* up0;
+    const uint64_t* up1_offsets;
+    const void* up1;
+    void* map;
+    size_t size;
+};
+
+// map the file at path (NULL if it cannot be read or is not a valid binary HDA)
+struct hda_binary* hda_binary_open(const char* path);
+void hda_binary_close(struct hda_binary* b);
+
+static inline size_t hda_binary_nb_cells(const struct hda_binary* b) {
+    return b->header->nb_cells;
+}
+
+// dimension of the cell i
+static inline size_t hda_binary_dim(const struct hda_binary* b, size_t i) {
+    size_t d = 0;
+    while (d + 1 < b->header->nb_dims && b->dims[d + 1] <= i)
+        d++;
+    return d;
+}
+
+static inline size_t _hda_binary_index(const struct hda_binary* b, const void* ids, size_t k) {
+    return b->header->index_width == 4 ? ((const uint32_t*) ids)[k] : (size_t)((const uint64_t*) ids)[k];
+}
+
+static inline size_t hda_binary_d0_length(const struct hda_binary* b, size_t i) {
+    return b->d0_offsets[i + 1] - b->d0_offsets[i];
+}
+
+// k-th face of d0 of cell i
+static inline size_t hda_binary_d0(const struct hda_binary* b, size_t i, size_t k) {
+    return _hda_binary_index(b, b->d0, b->d0_offsets[i] + k);
+}
+
+static inline size_t hda_binary_d1_length(const struct hda_binary* b, size_t i) {
+    return b->d1_offsets[i + 1] - b->d1_offsets[i];
+}
+
+// k-th face of d1 of cell i
+static inline size_t hda_binary_d1(const struct hda_binary* b, size_t i, size_t k) {
+    return _hda_binary_index(b, b->d1, b->d1_offsets[i] + k);
+}
+
+static inline bool hda_binary_has_cofaces(const struct hda_binary* b) {
+    return b->up0_offsets != NULL;
+}
+
+static inline size_t hda_binary_up0_length(const struct hda_binary* b, size_t i) {
+    return b->up0_offsets[i + 1] - b->up0_offsets[i];
+}
+
+// k-th coface of cell i having it in its d0
+static inline size_t hda_binary_up0(const struct hda_binary* b, size_t i, size_t k) {
+    return _hda_binary_index(b, b->up0, b->up0_offsets[i] + k);
+}
+
+static inline size_t hda_binary_up1_length(const struct hda_binary* b, size_t i) {
+    return b->up1_offsets[i + 1] - b->up1_offsets[i];
+}
+
+// k-th coface of cell i having it in its d1
+static inline size_t hda_binary_up1(const struct hda_binary* b, size_t i, size_t k) {
+    return _hda_binary_index(b, b->up1, b->up1_offsets[i] + k);
+}
+
+static inline size_t hda_binary_labels_length(const struct hda_binary* b, size_t i) {
+    return b->labels_offsets[i + 1] - b->labels_offsets[i];
+}
+
+// name of the k-th label of cell i
+static inline const char* hda_binary_label(const struct hda_binary* b, size_t i, size_t k) {
+    return b->label_strings + b->label_names[b->labels[b->labels_offsets[i] + k]];
+}
+
+#endif // HDA_BINARY_H
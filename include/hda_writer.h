@@ -0,0 +1,21 @@
+#ifndef HDA_WRITER_H
+#define HDA_WRITER_H
+
+#include <stdio.h>
+
+#include "hda.h"
+#include "vector.h"
+
+// Streaming output of an HDA: cells are formatted and written by a dedicated thread while
+// the exploration goes on. Cells are numbered by their id, in the order they are handed over
+// (which is not sorted by dimension, unlike print_hda).
+struct hda_writer;
+
+// start the writer thread, at most capacity cells are waiting to be written (labels: names of the label ids)
+struct hda_writer* hda_writer_start(FILE* out, struct vector* labels, size_t capacity);
+// hand over a cell whose boundaries will not change anymore (blocks while the queue is full)
+void hda_writer_push(struct hda_writer* writer, struct cell* c);
+// write every cell handed over, stop the thread and free the writer: return the number of cells written
+size_t hda_writer_finish(struct hda_writer* writer);
+
+#endif // HDA_WRITER_H
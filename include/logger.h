@@ -24,23 +24,23 @@ enum log_level {
 #endif // SOURCE_PATH_SIZE
 #define __FILENAME__ ((__FILE__) + (SOURCE_PATH_SIZE))
 
+// Level under which the LOG calls are compiled out (cmake -Dlog_min_level=WARNING): the call
+// sites of a constant level below it are removed by the compiler, arguments included.
+#ifndef LOG_MIN_LEVEL
+    #define LOG_MIN_LEVEL INFO
+#endif // LOG_MIN_LEVEL
+
+// Level under which nothing is written at run time (the --log-level option, raised to ERROR when the
+// logs are neither displayed nor stored in a file): checked before the arguments are evaluated.
+extern enum log_level logger_min_level;
+
 #ifdef NOLOG
-    #define LOG(LEVEL, FMT, ...) (void)LEVEL
+    #define LOG(LEVEL, FMT, ...) (void)(LEVEL)
 #else
     #define LOG(LEVEL, FMT, ...) \
-        do { \
-            int __n = snprintf(NULL, 0, (FMT), __VA_ARGS__); \
-            if (__n < 0) { \
-                break; \
-            } \
-            size_t __size = (size_t) __n + 1; \
-            char* __buff = malloc(__size * sizeof(*__buff)); \
-            if (__buff == NULL) { \
-                break; \
-            } \
-            snprintf(__buff, __size, (FMT), __VA_ARGS__); \
-            logger_log((LEVEL), __FILENAME__, __LINE__, __func__, __buff); \
-        } while(0)
+        ((int) (LEVEL) >= (int) (LOG_MIN_LEVEL) && (int) (LEVEL) >= (int) logger_min_level \
+            ? logger_log((LEVEL), __FILENAME__, __LINE__, __func__, (FMT), __VA_ARGS__) \
+            : (void) 0)
 #endif // NOLOG
 
 struct logger_options {
@@ -48,6 +48,7 @@ struct logger_options {
     // if true, all logs INFO, and WARNING will be displayed on stdout and TIMEOUT on stderr
     // all log marked as FATAL or ERROR will be displayed on stderr even if output_logs if set to false
     bool show_date;
+    enum log_level min_level; // the logs of lower levels are not written (INFO by default)
 #ifdef __linux__
     bool show_thread_id;
 #endif // __linux__
@@ -56,6 +57,17 @@ struct logger_options {
 void logger_set_options(struct logger_options options);
 bool logger_set_outfile(const char* filename);
 void logger_close_outfile(void);
-void logger_log(enum log_level level, const char* file_name, size_t line, const char* func_name, char* message);
+// level of name (INFO, WARNING, ...): false if there is no such level
+bool logger_level_from_name(const char* name, enum log_level* level);
+// The record is formatted in a ring buffer of the calling thread (no allocation, messages longer
+// than LOGGER_MESSAGE_SIZE are truncated) and written in batches by a background thread, the
+// records of all the threads merged in the order of the calls (a record is held back until the
+// records of the earlier calls are formatted). ERROR and FATAL records are written before
+// logger_log returns, and every record is written before the process exits.
+#define LOGGER_MESSAGE_SIZE 512
+void logger_log(enum log_level level, const char* file_name, size_t line, const char* func_name, const char* fmt, ...)
+    __attribute__((format(printf, 5, 6)));
+// write the records logged so far
+void logger_flush(void);
 
 #endif // LOGGER_H
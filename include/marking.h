@@ -0,0 +1,89 @@
+#ifndef MARKING_H
+#define MARKING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "petri_nets.h"
+#include "vector.h"
+
+// A marking is a fixed-length array of packed counters (1, 2 or 4 bytes per place, chosen per net)
+// stored inline after a small header. Markings are allocated in a marking_arena and never freed
+// one by one: successors are computed in a scratch marking and copied in the arena only if new.
+struct marking {
+    size_t hash; // incremental hash of the counters (see marking_hash)
+    uint32_t nb_places;
+    uint32_t width; // size of one counter in bytes
+    unsigned char counters[];
+};
+
+struct marking_arena;
+
+// smallest counter width able to hold every reachable marking of pn (4 if it cannot be bounded)
+uint32_t marking_width_for_net(struct petri_net* pn);
+
+struct marking_arena* marking_arena_new(uint32_t nb_places, uint32_t width);
+void marking_arena_destroy(struct marking_arena* arena);
+size_t marking_arena_size(struct marking_arena* arena); // number of bytes allocated
+size_t marking_size(uint32_t nb_places, uint32_t width); // number of bytes of one marking
+// scratch marking (malloc'd, to be freed by the caller) with the layout of the arena
+struct marking* marking_scratch_new(struct marking_arena* arena);
+// copy m in the arena and return the copy (or NULL if not enough memory)
+struct marking* marking_arena_commit(struct marking_arena* arena, const struct marking* m);
+// load a Vector(size_t) marking (return false if a value does not fit in the counters)
+bool marking_from_vector(struct marking* out, struct vector* v);
+// compute the hash of m from its counters (after they are written directly)
+void marking_rehash(struct marking* m);
+
+size_t marking_transition_is_activable(struct pn_transition* t, const struct marking* m);
+// write in out the marking m with the transition t started (resp. ended)
+// return false if t is not activable (resp. if a counter overflows)
+bool marking_start_transition(struct pn_transition* t, const struct marking* m, struct marking* out);
+bool marking_end_transition(struct pn_transition* t, const struct marking* m, struct marking* out);
+
+// A transition enabled in a marking and the number of its instances activable in it.
+// Lists of enabled transitions are sorted by transition index.
+struct marking_enabled {
+    size_t transition;
+    size_t count;
+};
+VECTOR_DEFINE(enabled_list, struct marking_enabled, 8)
+// list of places or transitions
+VECTOR_DEFINE(index_list, size_t, 16)
+
+// reverse index of a net: the transitions consuming from each place
+struct marking_consumers;
+
+struct marking_consumers* marking_consumers_new(struct petri_net* pn);
+void marking_consumers_destroy(struct marking_consumers* index);
+// write in out the transitions enabled in m: every transition is evaluated
+bool marking_enabled_all(struct marking_consumers* index, const struct marking* m, struct enabled_list* out);
+// write in out the transitions enabled in m, m being a marking whose enabled transitions are parent
+// with the counters of places (Vector(size_t)) modified: only the transitions consuming from
+// those places are evaluated again (touched is used as temporary)
+bool marking_enabled_update(struct marking_consumers* index, const struct marking_enabled* parent, size_t nb_parent,
+                            struct vector* places, const struct marking* m, struct index_list* touched, struct enabled_list* out);
+
+size_t marking_hash(const void* m);
+size_t marking_cmp(const void* m1, const void* m2);
+
+static inline size_t marking_get(const struct marking* m, size_t place) {
+    switch (m->width) {
+        case 1:
+            return m->counters[place];
+        case 2: {
+            uint16_t v;
+            memcpy(&v, m->counters + 2 * place, sizeof(v));
+            return v;
+        }
+        default: {
+            uint32_t v;
+            memcpy(&v, m->counters + 4 * place, sizeof(v));
+            return v;
+        }
+    }
+}
+
+#endif // MARKING_H
@@ -8,6 +8,7 @@
 
 struct pn_transition {
     char* label; // string
+    size_t label_id; // index of the label in petri_net.labels
     Vector(size_t) preset; // vector<size_t> where int represent the index of the input places
     Vector(size_t) postset; // vector<size_t> like above but for output places
 };
@@ -16,19 +17,20 @@ struct petri_net {
     Vector(struct pn_transition*) transitions; // vector<struct pn_transition*>
     Vector(size_t) marking; // vector<size_t> where each int represent the number of ressources at the given place
     // ie: place i has marking[i] ressources
+    Vector(char*) labels; // distinct transition labels (strings owned by the transitions)
+    char* id; // id attribute of the net (NULL if unknown)
 };
 
 struct pn_transition* pn_transition_new(const char* label);
 void pn_transition_destroy(struct pn_transition* t);
 struct petri_net* petri_net_new(void);
 void petri_net_destroy(struct petri_net* pn);
-struct petri_net* parse_xml_file(xmlNodePtr root);
+// parse the first P/T net of the PNML file at path in one streaming pass (NULL on error)
+struct petri_net* parse_pnml_file(const char* path);
+// every P/T net of the PNML file at path, in document order (NULL on error)
+Vector(struct petri_net*) parse_pnml_nets(const char* path);
 void pn_pretty_print(struct petri_net* pn);
-struct vector* marking_copy(struct vector* marking);
-size_t pn_transition_is_activable(struct vector* transitions, struct vector* marking, size_t transition_idx);
-struct vector* pn_start_transition(struct vector* transitions, struct vector* marking, size_t transition_idx);
-struct vector* pn_end_transition(struct vector* transitions, struct vector* marking, size_t transition_idx);
-size_t marking_hash(const void* m);
-bool is_same_marking(struct vector* m1, struct vector* m2);
+// give each transition the dense id of its label in pn->labels
+bool petri_net_intern_labels(struct petri_net* pn);
 
 #endif // PETRI_NETS_H
@@ -0,0 +1,77 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Counters of the conversion hot paths, written in JSON by --stats.
+// Every thread counts in its own block (no atomic operation, no shared cache line), the blocks are
+// summed when the statistics are written. With NOSTATS (cmake -Dactive_stats=NO) the STATS_
+// macros expand to nothing and the hot paths are left as they were.
+
+#define STATS_MAX_DIMS 64 // the cells of larger dimensions are counted in the last one
+#define STATS_PROBE_LENGTHS 16 // groups of control bytes probed by a lookup: 1 .. 15, 16 or more
+
+struct stats {
+    size_t cells_per_dim[STATS_MAX_DIMS];
+    size_t successors; // cells reached from a cell by starting or ending a transition
+    size_t new_successors; // the ones which were not in the visited cells yet
+    size_t filter_calls; // adjacency filter run on a visited cell with the right key
+    size_t filter_rejections;
+    size_t filter_probes; // calls not settled by the adjacency filter of the found cell (link set looked up)
+    size_t max_depth; // frames of the sequential exploration
+    size_t lookups; // hashtbl lookups
+    size_t probe_lengths[STATS_PROBE_LENGTHS];
+    size_t key_compares; // keys compared because their tag matched
+    size_t table_resizes; // new tables allocated by hashtbl_expand
+    size_t transitions_started; // calls of marking_start_transition
+    size_t transitions_ended;
+    size_t markings_committed; // markings copied in an arena
+    size_t enabled_updates; // calls of marking_enabled_update
+};
+
+enum stats_phase {
+    STATS_PARSE,
+    STATS_CONVERT,
+    STATS_PRINT,
+    STATS_NB_PHASES,
+};
+
+#ifdef NOSTATS
+    #define STATS_INC(FIELD) ((void) 0)
+    #define STATS_MAX(FIELD, VALUE) ((void) 0)
+    #define STATS_HISTOGRAM(FIELD, VALUE) ((void) 0)
+    #define STATS_PHASE_START(PHASE) ((void) 0)
+    #define STATS_PHASE_END(PHASE) ((void) 0)
+#else
+    // block of the calling thread
+    #define STATS_LOCAL() (stats_local ? stats_local : stats_register())
+    #define STATS_INC(FIELD) ((void) STATS_LOCAL()->FIELD++)
+    #define STATS_MAX(FIELD, VALUE) \
+        do { \
+            struct stats* __s = STATS_LOCAL(); \
+            size_t __v = (VALUE); \
+            if (__v > __s->FIELD) __s->FIELD = __v; \
+        } while (0)
+    // count VALUE (>= 1) in the histogram FIELD, its last entry counting the larger values
+    #define STATS_HISTOGRAM(FIELD, VALUE) \
+        do { \
+            size_t __v = (VALUE), __n = sizeof(stats_local->FIELD) / sizeof(size_t); \
+            STATS_LOCAL()->FIELD[(__v < __n ? __v : __n) - 1]++; \
+        } while (0)
+    #define STATS_PHASE_START(PHASE) stats_phase_start(PHASE)
+    #define STATS_PHASE_END(PHASE) stats_phase_end(PHASE)
+#endif // NOSTATS
+
+extern __thread struct stats* stats_local;
+// allocate the block of the calling thread (kept until stats_release): if there is not enough
+// memory its counts go to a block shared by such threads (they may be lost)
+struct stats* stats_register(void);
+// the phases are timed with a monotonic clock, their durations are summed
+void stats_phase_start(enum stats_phase phase);
+void stats_phase_end(enum stats_phase phase);
+// write the sum of the blocks of all the threads in the JSON file path
+bool stats_write(const char* path);
+void stats_release(void);
+
+#endif // STATS_H
@@ -3,6 +3,9 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define Vector(T) struct vector*
 
@@ -27,5 +30,100 @@ bool vector_resize(struct vector* v, size_t new_cap);
 bool vector_push(struct vector* v, void* restrict elm);
 // return the address of the last element in the vector (or NULL if empty)
 void* vector_pop(struct vector* v);
+// remove all the elements (the capacity is kept)
+void vector_clear(struct vector* v);
+
+// Type specialised vector: VECTOR_DEFINE(NAME, T, INLINE_CAP) defines `struct NAME', a vector of T
+// whose first INLINE_CAP (> 0) elements are stored inline (short vectors allocate nothing), and
+// static inline functions NAME_xxx working on it, so the accesses of the hot loops are inlined.
+// Elements are passed by value. A vector does not point to itself: it can be moved by memcpy.
+//     NAME_init / NAME_destroy: empty vector with the inline capacity / release its storage
+//     NAME_array, NAME_length, NAME_is_empty, NAME_last (the vector must not be empty)
+//     NAME_reserve: capacity of exactly capacity elements if larger than the current one
+//     NAME_push (the capacity doubles when full), NAME_pop (the vector must not be empty), NAME_clear
+//     NAME_truncate: keep the first length elements (length <= NAME_length)
+//     NAME_append_n: push the n elements of elms at once
+//     NAME_clone: initialize out with a copy of the elements of v (allocated once)
+// The functions which allocate return false (the vector is unchanged) if there is not enough memory.
+#define VECTOR_DEFINE(NAME, T, INLINE_CAP) \
+struct NAME { \
+    size_t length; \
+    size_t capacity; /* > INLINE_CAP: the elements are in data.heap */ \
+    union { \
+        T inline_elms[INLINE_CAP]; \
+        T* heap; \
+    } data; \
+}; \
+static inline void NAME##_init(struct NAME* v) { \
+    v->length = 0; \
+    v->capacity = INLINE_CAP; \
+} \
+static inline void NAME##_destroy(struct NAME* v) { \
+    if (v->capacity > INLINE_CAP) \
+        free(v->data.heap); \
+} \
+static inline T* NAME##_array(struct NAME* v) { \
+    return v->capacity > INLINE_CAP ? v->data.heap : v->data.inline_elms; \
+} \
+static inline size_t NAME##_length(const struct NAME* v) { \
+    return v->length; \
+} \
+static inline bool NAME##_is_empty(const struct NAME* v) { \
+    return !v->length; \
+} \
+static inline T* NAME##_last(struct NAME* v) { \
+    return NAME##_array(v) + v->length - 1; \
+} \
+static inline bool NAME##_reserve(struct NAME* v, size_t capacity) { \
+    if (capacity <= v->capacity) \
+        return true; \
+    if (capacity > SIZE_MAX / sizeof(T)) \
+        return false; \
+    T* heap = v->capacity > INLINE_CAP ? realloc(v->data.heap, capacity * sizeof(T)) : malloc(capacity * sizeof(T)); \
+    if (!heap) \
+        return false; \
+    if (v->capacity <= INLINE_CAP) \
+        memcpy(heap, v->data.inline_elms, v->length * sizeof(T)); \
+    v->data.heap = heap; \
+    v->capacity = capacity; \
+    return true; \
+} \
+static inline bool NAME##_grow(struct NAME* v, size_t n) { \
+    if (v->length + n <= v->capacity) \
+        return true; \
+    if (n > SIZE_MAX / 2 - v->length) \
+        return false; \
+    return NAME##_reserve(v, v->length + n > 2 * v->capacity ? v->length + n : 2 * v->capacity); \
+} \
+static inline bool NAME##_push(struct NAME* v, T elm) { \
+    if (v->length == v->capacity && !NAME##_grow(v, 1)) \
+        return false; \
+    NAME##_array(v)[v->length++] = elm; \
+    return true; \
+} \
+static inline T NAME##_pop(struct NAME* v) { \
+    return NAME##_array(v)[--v->length]; \
+} \
+static inline void NAME##_clear(struct NAME* v) { \
+    v->length = 0; \
+} \
+static inline void NAME##_truncate(struct NAME* v, size_t length) { \
+    v->length = length; \
+} \
+static inline bool NAME##_append_n(struct NAME* v, const T* elms, size_t n) { \
+    if (!n) \
+        return true; \
+    if (!NAME##_grow(v, n)) \
+        return false; \
+    memcpy(NAME##_array(v) + v->length, elms, n * sizeof(T)); \
+    v->length += n; \
+    return true; \
+} \
+static inline bool NAME##_clone(struct NAME* out, struct NAME* v) { \
+    NAME##_init(out); \
+    if (!NAME##_reserve(out, v->length)) \
+        return false; \
+    return NAME##_append_n(out, NAME##_array(v), v->length); \
+}
 
 #endif // VECTOR_H
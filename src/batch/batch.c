@@ -0,0 +1,213 @@
+#define _POSIX_C_SOURCE 200809L
+#include "batch.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logger.h"
+#include "petri_nets.h"
+#include "hda.h"
+#include "hda_binary.h"
+
+struct _job {
+    struct petri_net* net;
+    char* output;
+};
+
+struct _batch {
+    pthread_mutex_t lock;
+    pthread_cond_t cond; // jobs pushed or no more file to parse
+    const char* const* files;
+    size_t nb_files;
+    size_t next_file;
+    size_t nb_parsing; // files being parsed: their nets are not in jobs yet
+    Vector(struct _job) jobs;
+    size_t nb_failures;
+    struct batch_options options;
+};
+
+Vector(char*) batch_read_list(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return NULL;
+    Vector(char*) files = vector_new(sizeof(char*), 0);
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t n;
+    while (files && (n = getline(&line, &size, f)) >= 0) {
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r' || line[n - 1] == ' ' || line[n - 1] == '\t'))
+            line[--n] = 0;
+        if (!n || line[0] == '#')
+            continue;
+        char* file = strdup(line);
+        if (!file || !vector_push(files, &file)) {
+            free(file);
+            LOG(ERROR, "Unable to read the list of files `%s': not enough memory", path);
+            break;
+        }
+    }
+    free(line);
+    fclose(f);
+    return files;
+}
+
+// output file of the net (its index in the file is i, the file contains nb_nets nets)
+static char* _output_name(const char* file, const char* output_dir, struct petri_net* net, size_t i, size_t nb_nets, bool binary) {
+    const char* base = strrchr(file, '/');
+    base = base ? base + 1 : file;
+    size_t dir_length = output_dir ? strlen(output_dir) : (size_t)(base - file);
+    const char* dot = strrchr(base, '.');
+    size_t base_length = dot && dot != base ? (size_t)(dot - base) : strlen(base);
+    char index[32] = { 0 };
+    const char* id = net->id;
+    if (nb_nets > 1 && !id) {
+        snprintf(index, sizeof(index), "%zu", i);
+        id = index;
+    }
+    size_t id_length = nb_nets > 1 ? strlen(id) + 1 : 0;
+    const char* ext = binary ? ".hdab" : ".hda";
+    char* out = malloc(dir_length + 1 + base_length + id_length + strlen(ext) + 1);
+    if (!out)
+        return NULL;
+    char* o = out;
+    memcpy(o, output_dir ? output_dir : file, dir_length);
+    o += dir_length;
+    if (output_dir && dir_length && output_dir[dir_length - 1] != '/')
+        *o++ = '/';
+    memcpy(o, base, base_length);
+    o += base_length;
+    if (id_length) {
+        *o++ = '.';
+        // net ids are not file names
+        for (const char* c = id; *c; c++)
+            *o++ = *c == '/' ? '_' : *c;
+    }
+    strcpy(o, ext);
+    return out;
+}
+
+static bool _convert(struct _job* job, struct batch_options* options) {
+    struct conversion_options conversion_options = options->conversion;
+    conversion_options.nb_threads = 1;
+    conversion_options.writer = NULL;
+    struct hda* hda = conversion(job->net, conversion_options);
+    bool ok = false;
+    if (options->cofaces && !hda_build_cofaces(hda, 1))
+        LOG(ERROR, "Unable to build the cofaces of the HDA of `%s': not enough memory", job->output);
+    FILE* out = fopen(job->output, options->binary ? "wb" : "w");
+    if (!out) {
+        LOG(ERROR, "Cannot open output file `%s'", job->output);
+    } else {
+        if (options->binary)
+            ok = hda_write_binary(hda, out);
+        else
+            print_hda(hda, out), ok = !ferror(out);
+        ok = !fclose(out) && ok;
+        if (!ok)
+            LOG(ERROR, "Unable to write the HDA in `%s'", job->output);
+        else if (hda->status != CONVERSION_COMPLETE)
+            LOG(TIMEOUT, "Partial HDA of %zu cells written to `%s': %zu of them in the unexplored frontier", cell_arena_length(hda->cells), job->output, hda->nb_unexplored);
+        else
+            LOG(INFO, "HDA of %zu cells written to `%s'", cell_arena_length(hda->cells), job->output);
+    }
+    free_hda(hda, true);
+    petri_net_destroy(job->net);
+    free(job->output);
+    return ok;
+}
+
+// parse the file and push a job per net (return false if a net or the file cannot be read)
+static bool _parse(struct _batch* b, const char* file) {
+    Vector(struct petri_net*) nets = parse_pnml_nets(file);
+    if (!nets) {
+        LOG(ERROR, "Unable to get P/T nets from file `%s'", file);
+        return false;
+    }
+    size_t nb_nets = vector_length(nets);
+    if (!nb_nets)
+        LOG(WARNING, "No P/T net found in file `%s'", file);
+    struct petri_net** n = vector_to_array(nets);
+    bool ok = true;
+    pthread_mutex_lock(&b->lock);
+    for (size_t i = 0; i < nb_nets; i++) {
+        struct _job job = { .net = n[i], .output = _output_name(file, b->options.output_dir, n[i], i, nb_nets, b->options.binary) };
+        if (!job.output || !vector_push(b->jobs, &job)) {
+            LOG(ERROR, "Net %zu of file `%s' skipped: not enough memory", i, file);
+            free(job.output);
+            petri_net_destroy(n[i]);
+            ok = false;
+        }
+    }
+    pthread_mutex_unlock(&b->lock);
+    vector_destroy(nets);
+    return ok;
+}
+
+static void* _worker(void* args) {
+    struct _batch* b = args;
+    pthread_mutex_lock(&b->lock);
+    while (true) {
+        if (!vector_is_empty(b->jobs)) {
+            struct _job job = *(struct _job*) vector_pop(b->jobs);
+            pthread_mutex_unlock(&b->lock);
+            bool ok = _convert(&job, &b->options);
+            pthread_mutex_lock(&b->lock);
+            b->nb_failures += !ok;
+        } else if (b->next_file < b->nb_files) {
+            const char* file = b->files[b->next_file++];
+            b->nb_parsing++;
+            pthread_mutex_unlock(&b->lock);
+            bool ok = _parse(b, file);
+            pthread_mutex_lock(&b->lock);
+            b->nb_failures += !ok;
+            b->nb_parsing--;
+            pthread_cond_broadcast(&b->cond);
+        } else if (b->nb_parsing) {
+            pthread_cond_wait(&b->cond, &b->lock);
+        } else {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&b->lock);
+    return NULL;
+}
+
+size_t batch_convert(const char* const* files, size_t nb_files, struct batch_options options) {
+    struct _batch b = {
+        .files = files,
+        .nb_files = nb_files,
+        .jobs = vector_new(sizeof(struct _job), 0),
+        .options = options,
+    };
+    if (!b.jobs) {
+        LOG(FATAL, "%s", "not enough memory");
+        exit(1); // FIXME error handling
+    }
+    if (!options.nb_threads) options.nb_threads = 1;
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.cond, NULL);
+    pthread_t* threads = malloc(options.nb_threads * sizeof(*threads));
+    if (!threads) {
+        LOG(FATAL, "%s", "not enough memory");
+        exit(1); // FIXME error handling
+    }
+
+    size_t nb_started = 1;
+    for (; nb_started < options.nb_threads; nb_started++) {
+        if (pthread_create(&threads[nb_started], NULL, _worker, &b)) {
+            LOG(WARNING, "Unable to start batch thread %zu: continue with %zu threads", nb_started, nb_started);
+            break;
+        }
+    }
+    _worker(&b);
+    for (size_t i = 1; i < nb_started; i++)
+        pthread_join(threads[i], NULL);
+
+    free(threads);
+    pthread_cond_destroy(&b.cond);
+    pthread_mutex_destroy(&b.lock);
+    vector_destroy(b.jobs);
+    return b.nb_failures;
+}
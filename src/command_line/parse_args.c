@@ -18,6 +18,7 @@ struct argument {
 };
 
 static Vector(struct argument) arguments = NULL;
+static Vector(char*) positional_arguments = NULL; // point in the args of parse_command_line
 
 void add_argument(const char* name, char short_name, const char* description, bool is_flag, arg_default_value default_value) {
     if (!arguments) arguments = vector_new(sizeof(struct argument), 0);
@@ -37,6 +38,15 @@ void add_argument(const char* name, char short_name, const char* description, bo
     vector_push(arguments, &arg);
 }
 
+// option names are compared with '-' and '_' as the same character (--log-file or --log_file)
+static bool same_name(const char* a, const char* b) {
+    for (; *a && *b; a++, b++) {
+        if (*a != *b && !((*a == '-' || *a == '_') && (*b == '-' || *b == '_')))
+            return false;
+    }
+    return *a == *b;
+}
+
 static void free_one_arg(void* arg, __attribute__((unused))void* unsed) {
     struct argument *a = arg;
     free(a->description);
@@ -48,15 +58,21 @@ void free_argument_parser(void) {
     vector_forall(arguments, free_one_arg, NULL);
     vector_destroy(arguments);
     arguments = NULL;
+    if (positional_arguments)
+        vector_destroy(positional_arguments);
+    positional_arguments = NULL;
 }
 
 bool parse_command_line(int argc, char **args) {
+    if (!positional_arguments) positional_arguments = vector_new(sizeof(char*), 0);
     for (int i = 1; i < argc; i++) {
-        if (args[i][0] == '-') {
+        if (args[i][0] != '-' || !args[i][1]) {
+            vector_push(positional_arguments, &args[i]);
+        } else {
             bool is_found = false;
             struct argument *a = vector_to_array(arguments);
             for (size_t j = 0; j < vector_length(arguments); j++) {
-                if ((args[i][1] == '-' && !strcmp(args[i] + 2, a[j].name))
+                if ((args[i][1] == '-' && same_name(args[i] + 2, a[j].name))
                     || (args[i][1] && args[i][1] == a[j].short_name && !args[i][2])) {
                     if (a[j].is_flag)
                         a[j].user.is_set = true;
@@ -98,7 +114,7 @@ void display_help(const char* header) {
 static bool is_equal(void* a, void* b) {
     struct argument* arg = a;
     const char* name = b;
-    return strcmp(arg->name, name) == 0;
+    return same_name(arg->name, name);
 }
 
 bool is_flag_set(const char* name) {
@@ -120,3 +136,13 @@ const char* get_argument_value(const char* name) {
         return NULL;
     return a[idx].user.value;
 }
+
+size_t get_nb_positional_arguments(void) {
+    return positional_arguments ? vector_length(positional_arguments) : 0;
+}
+
+const char* get_positional_argument(size_t i) {
+    if (i >= get_nb_positional_arguments())
+        return NULL;
+    return ((char**) vector_to_array(positional_arguments))[i];
+}
@@ -0,0 +1,203 @@
+#define _POSIX_C_SOURCE 200809L
+#include "cell_arena.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hda.h"
+#include "vector.h"
+
+#define SLAB_BITS 16
+#define SLAB_SIZE (1ul << SLAB_BITS)
+#define MAX_SLABS (1ul << (32 - SLAB_BITS))
+#define POOL_BLOCK_SIZE (1ul << 16)
+
+struct id_pool {
+    Vector(uint32_t*) blocks;
+    uint32_t* current; // next free id of the last block
+    size_t left; // number of free ids in the last block
+};
+
+struct cell_arena {
+    struct cell** slabs; // MAX_SLABS slabs of SLAB_SIZE cells followed by their flags, allocated on demand
+    size_t length; // number of allocated cells (atomic)
+    pthread_mutex_t pools_lock;
+    Vector(struct id_pool*) pools;
+};
+
+static uint32_t* _pool_alloc(struct id_pool* pool, size_t n) {
+    if (pool->left < n) {
+        size_t size = n > POOL_BLOCK_SIZE ? n : POOL_BLOCK_SIZE;
+        uint32_t* block = malloc(size * sizeof(*block));
+        if (!block) return NULL;
+        if (!vector_push(pool->blocks, &block)) {
+            free(block);
+            return NULL;
+        }
+        pool->current = block;
+        pool->left = size;
+    }
+    uint32_t* out = pool->current;
+    pool->current += n;
+    pool->left -= n;
+    return out;
+}
+
+#define FREE_SLOT UINT32_MAX
+
+// log2 of the number of slots of the set of a list of the given capacity (> CELL_LIST_SCAN_MAX):
+// the power of two >= 2 * capacity
+static inline unsigned _set_bits(uint32_t capacity) {
+    return 32 - (unsigned) __builtin_clz(2 * capacity - 1);
+}
+
+static inline uint32_t _set_slot(uint32_t id, unsigned bits) {
+    return (id * 0x9e3779b1u) >> (32 - bits);
+}
+
+static void _set_insert(uint32_t* set, unsigned bits, uint32_t id) {
+    uint32_t mask = (1u << bits) - 1;
+    uint32_t i = _set_slot(id, bits);
+    for (; set[i] != FREE_SLOT && set[i] != id; i = (i + 1) & mask)
+        ;
+    set[i] = id;
+}
+
+bool cell_list_reserve(struct cell_list* l, uint32_t capacity, struct id_pool* pool) {
+    if (capacity <= l->capacity || capacity <= CELL_LIST_INLINE) {
+        if (l->capacity < capacity)
+            l->capacity = capacity;
+        return true;
+    }
+    // the previous array is left in the pool: lists only grow geometrically
+    size_t nb_slots = capacity > CELL_LIST_SCAN_MAX ? 1ul << _set_bits(capacity) : 0;
+    uint32_t* ids = _pool_alloc(pool, capacity + nb_slots);
+    if (!ids) return false;
+    memcpy(ids, cell_list_array(l), l->length * sizeof(*ids));
+    if (nb_slots) {
+        memset(ids + capacity, 0xff, nb_slots * sizeof(*ids));
+        for (uint32_t i = 0; i < l->length; i++)
+            _set_insert(ids + capacity, _set_bits(capacity), ids[i]);
+    }
+    l->data.ids = ids;
+    l->capacity = capacity;
+    return true;
+}
+
+bool cell_list_push(struct cell_list* l, uint32_t id, struct id_pool* pool) {
+    if (l->length >= l->capacity && !cell_list_reserve(l, l->capacity < CELL_LIST_INLINE ? CELL_LIST_INLINE : 2 * l->capacity, pool))
+        return false;
+    uint32_t* ids = cell_list_array(l);
+    ids[l->length++] = id;
+    if (l->capacity > CELL_LIST_SCAN_MAX)
+        _set_insert(ids + l->capacity, _set_bits(l->capacity), id);
+    return true;
+}
+
+bool cell_list_set_contains(struct cell_list* l, uint32_t id) {
+    uint32_t* set = l->data.ids + l->capacity;
+    unsigned bits = _set_bits(l->capacity);
+    uint32_t mask = (1u << bits) - 1;
+    for (uint32_t i = _set_slot(id, bits); set[i] != FREE_SLOT; i = (i + 1) & mask) {
+        if (set[i] == id)
+            return true;
+    }
+    return false;
+}
+
+struct cell_arena* cell_arena_new(void) {
+    struct cell_arena* arena = calloc(1, sizeof(*arena));
+    if (!arena) return NULL;
+    arena->slabs = calloc(MAX_SLABS, sizeof(*(arena->slabs)));
+    arena->pools = vector_new(sizeof(struct id_pool*), 0);
+    if (!arena->slabs || !arena->pools) {
+        free(arena->slabs);
+        if (arena->pools) vector_destroy(arena->pools);
+        free(arena);
+        return NULL;
+    }
+    pthread_mutex_init(&arena->pools_lock, NULL);
+    return arena;
+}
+
+static void _free_block(void* block, __attribute__((unused))void* unused) {
+    free(*(uint32_t**)block);
+}
+
+static void _free_pool(void* pool, __attribute__((unused))void* unused) {
+    struct id_pool* p = *(struct id_pool**)pool;
+    vector_forall(p->blocks, _free_block, NULL);
+    vector_destroy(p->blocks);
+    free(p);
+}
+
+void cell_arena_destroy(struct cell_arena* arena) {
+    if (!arena) return;
+    size_t nb_slabs = (arena->length + SLAB_SIZE - 1) >> SLAB_BITS;
+    for (size_t i = 0; i < nb_slabs && i < MAX_SLABS; i++)
+        free(arena->slabs[i]);
+    vector_forall(arena->pools, _free_pool, NULL);
+    vector_destroy(arena->pools);
+    pthread_mutex_destroy(&arena->pools_lock);
+    free(arena->slabs);
+    free(arena);
+}
+
+struct id_pool* cell_arena_new_pool(struct cell_arena* arena) {
+    struct id_pool* pool = calloc(1, sizeof(*pool));
+    if (!pool) return NULL;
+    if (!(pool->blocks = vector_new(sizeof(uint32_t*), 0))) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_lock(&arena->pools_lock);
+    bool ok = vector_push(arena->pools, &pool);
+    pthread_mutex_unlock(&arena->pools_lock);
+    if (!ok) {
+        vector_destroy(pool->blocks);
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+struct cell* cell_arena_alloc(struct cell_arena* arena, uint32_t dim, struct id_pool* pool) {
+    size_t id = __atomic_fetch_add(&arena->length, 1, __ATOMIC_RELAXED);
+    if (id >= MAX_SLABS * SLAB_SIZE)
+        return NULL;
+    size_t s = id >> SLAB_BITS;
+    struct cell* slab = __atomic_load_n(&arena->slabs[s], __ATOMIC_ACQUIRE);
+    if (!slab) {
+        struct cell* expected = NULL;
+        struct cell* new_slab = malloc(SLAB_SIZE * (sizeof(*new_slab) + sizeof(uint8_t)));
+        if (!new_slab) return NULL;
+        if (__atomic_compare_exchange_n(&arena->slabs[s], &expected, new_slab, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            slab = new_slab;
+        } else {
+            free(new_slab);
+            slab = expected;
+        }
+    }
+    struct cell* c = slab + (id & (SLAB_SIZE - 1));
+    memset(c, 0, sizeof(*c));
+    c->id = (cell_id) id;
+    *cell_arena_flags(arena, c->id) = 0;
+    c->dim = dim;
+    // d0 and d1 of a cell of dimension d have d faces (vertices grow inline up to 2 edges)
+    if (!cell_list_reserve(&c->d0, dim, pool) || !cell_list_reserve(&c->d1, dim, pool) || !cell_list_reserve(&c->labels, dim, pool))
+        return NULL;
+    return c;
+}
+
+size_t cell_arena_length(struct cell_arena* arena) {
+    return __atomic_load_n(&arena->length, __ATOMIC_ACQUIRE);
+}
+
+struct cell* cell_arena_get(struct cell_arena* arena, cell_id id) {
+    return arena->slabs[id >> SLAB_BITS] + (id & (SLAB_SIZE - 1));
+}
+
+uint8_t* cell_arena_flags(struct cell_arena* arena, cell_id id) {
+    return (uint8_t*)(arena->slabs[id >> SLAB_BITS] + SLAB_SIZE) + (id & (SLAB_SIZE - 1));
+}
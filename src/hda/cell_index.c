@@ -0,0 +1,184 @@
+#include "cell_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hashtbl.h"
+#include "vector.h"
+
+// cells of a key whose d0 was not full when they were last walked, in insertion order
+typedef struct cell* _cell_ptr; // so that const applies to the elements
+VECTOR_DEFINE(open_list, _cell_ptr, 4)
+
+// cells sharing one key: most keys have a single cell, the others are allocated on demand
+struct _bucket {
+    struct cell* first;
+    Vector(struct cell*) others;
+    struct open_list* open; // built by the first lookup on d0 which meets a full cell among others
+};
+
+struct cell_index {
+    // keys inline: a lookup only dereferences the markings, incremental: no pause when it grows
+    Hashtbl(struct cell_key, struct _bucket*) buckets;
+};
+
+size_t cell_key_hash(const struct cell_key* key) {
+    unsigned long long x = key->signature * 0x9e3779b97f4a7c15ull;
+    return marking_hash(key->marking) ^ (size_t)(x ^ (x >> 32));
+}
+
+static size_t _hash(const void* key) {
+    return cell_key_hash(key);
+}
+
+static size_t _cmp(const void* k1, const void* k2) {
+    const struct cell_key* a = k1;
+    const struct cell_key* b = k2;
+    if (a->nb_labels != b->nb_labels || a->signature != b->signature)
+        return 1;
+    if (marking_cmp(a->marking, b->marking))
+        return 1;
+    return a->nb_labels && memcmp(a->labels, b->labels, a->nb_labels * sizeof(uint32_t));
+}
+
+struct cell_index* cell_index_new(void) {
+    struct cell_index* index = malloc(sizeof(*index));
+    if (!index) return NULL;
+    HASHTBL_NEW(index->buckets, struct cell_key, struct _bucket*, .cmp_func = _cmp, .hash_func = _hash, .inline_keys = true, .incremental = true);
+    if (!index->buckets) {
+        free(index);
+        return NULL;
+    }
+    return index;
+}
+
+static void _free_bucket(struct hashtbl_element e, __attribute__((unused))void* unused) {
+    struct _bucket* b = e.value;
+    if (b->others)
+        vector_destroy(b->others);
+    if (b->open) {
+        open_list_destroy(b->open);
+        free(b->open);
+    }
+    free(b);
+}
+
+void cell_index_destroy(struct cell_index* index) {
+    if (!index) return;
+    hashtbl_forall(index->buckets, _free_bucket, NULL);
+    hashtbl_destroy(index->buckets);
+    free(index);
+}
+
+// the d0 of c is full: its dim faces, or 2 incoming edges for a vertex (d0 never shrinks)
+static inline bool _is_full(const struct cell* c) {
+    return c->d0.length >= (c->dim ? c->dim : 2);
+}
+
+// open list of the cells of b whose d0 is not full (NULL if not enough memory)
+static struct open_list* _open_list(struct _bucket* b) {
+    struct open_list* open = malloc(sizeof(*open));
+    if (!open)
+        return NULL;
+    open_list_init(open);
+    struct cell** cells = vector_to_array(b->others);
+    for (size_t i = 0; i <= vector_length(b->others); i++) {
+        struct cell* c = i ? cells[i - 1] : b->first;
+        if (!_is_full(c) && !open_list_push(open, c)) {
+            open_list_destroy(open);
+            free(open);
+            return NULL;
+        }
+    }
+    return open;
+}
+
+// first cell of the open list from start accepted by the filter, the full cells met are removed
+static struct cell* _find_open(struct open_list* open, size_t start, bool (*filter)(void* cell, void* extra_args), void* extra_args) {
+    struct cell** cells = open_list_array(open);
+    size_t length = open_list_length(open), kept = start, i = start;
+    struct cell* found = NULL;
+    while (i < length && !found) {
+        struct cell* c = cells[i++];
+        if (_is_full(c))
+            continue;
+        cells[kept++] = c;
+        if (filter(c, extra_args))
+            found = c;
+    }
+    if (kept < i) {
+        memmove(cells + kept, cells + i, (length - i) * sizeof(*cells));
+        open_list_truncate(open, kept + length - i);
+    }
+    return found;
+}
+
+struct cell* cell_index_find(struct cell_index* index, const struct cell_key* key, bool to_d0, bool (*filter)(void* cell, void* extra_args), void* extra_args) {
+    struct _bucket* b = hashtbl_find(index->buckets, (void*) key).value;
+    if (!b)
+        return NULL;
+    if (to_d0 && b->open)
+        return _find_open(b->open, 0, filter, extra_args);
+    struct cell** cells = b->others ? vector_to_array(b->others) : NULL;
+    size_t length = b->others ? vector_length(b->others) : 0;
+    // number of cells rejected by the filter so far
+    size_t rejected = 0;
+    for (size_t i = 0; i <= length; i++) {
+        struct cell* c = i ? cells[i - 1] : b->first;
+        if (to_d0 && _is_full(c)) {
+            // from now on the lookups on d0 only walk the cells which can still be linked,
+            // the rejected ones are the first ones of the list
+            if (length && (b->open = _open_list(b)))
+                return _find_open(b->open, rejected, filter, extra_args);
+            continue;
+        }
+        if (filter(c, extra_args))
+            return c;
+        rejected++;
+    }
+    return NULL;
+}
+
+bool cell_index_add(struct cell_index* index, const struct marking* m, struct cell* c) {
+    struct cell_key key = {
+        .marking = m,
+        .labels = cell_list_array(&c->labels),
+        .nb_labels = c->labels.length,
+        .signature = c->signature,
+    };
+    struct _bucket* b = hashtbl_find(index->buckets, &key).value;
+    if (b) {
+        if (!b->others && !(b->others = vector_new(sizeof(struct cell*), 4)))
+            return false;
+        return vector_push(b->others, &c) && (!b->open || open_list_push(b->open, c));
+    }
+    b = malloc(sizeof(*b));
+    if (!b) return false;
+    *b = (struct _bucket){ .first = c, .others = NULL, .open = NULL };
+    if (!hashtbl_add(index->buckets, &key, b, false)) {
+        free(b);
+        return false;
+    }
+    return true;
+}
+
+struct _forall_args {
+    void (*func)(const struct marking* m, struct cell* c, void* args);
+    void* args;
+};
+
+static void _forall_bucket(struct hashtbl_element e, void* args) {
+    struct _forall_args* a = args;
+    struct _bucket* b = e.value;
+    const struct marking* m = ((struct cell_key*) e.key)->marking;
+    a->func(m, b->first, a->args);
+    if (!b->others)
+        return;
+    struct cell** cells = vector_to_array(b->others);
+    for (size_t i = 0; i < vector_length(b->others); i++)
+        a->func(m, cells[i], a->args);
+}
+
+void cell_index_forall(struct cell_index* index, void (*func)(const struct marking* m, struct cell* c, void* args), void* args) {
+    hashtbl_forall(index->buckets, _forall_bucket, &(struct _forall_args){ func, args });
+}
@@ -0,0 +1,381 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logger.h"
+#include "hda.h"
+#include "cell_index.h"
+#include "conversion.h"
+#include "stats.h"
+
+#define CHECKPOINT_MAGIC "PN2HDACP"
+#define CHECKPOINT_VERSION 2
+#define NO_COPY UINT64_MAX
+#define FULL_MARKING UINT32_MAX
+
+// Snapshot layout (integers in the byte order of the writer):
+//     header
+//     nb_cells cells: cell_header, labels (uint32_t), d0, d1 (cell ids), marking
+//         the marking is the list of the changes from the marking of the previous cell in creation
+//         order (nb_changes pairs place, value of uint32_t), or its counters if nb_changes is FULL_MARKING
+//     nb_enabled enabled transitions: transition, count (uint64_t)
+//     stack_length transitions of the root transition stack (uint64_t)
+//     nb_frames frames: frame_header, length of the copy (NO_COPY if none), copy (uint64_t)
+struct _header {
+    char magic[8];
+    uint32_t version;
+    uint32_t width; // width of the counters of the markings
+    uint64_t net; // fingerprint of the net
+    uint64_t dim_bound; // the frames and the missing boundaries of the cells depend on it
+    uint64_t nb_cells;
+    uint64_t nb_enabled;
+    uint64_t stack_length;
+    uint64_t nb_frames;
+};
+
+struct _cell_header {
+    uint64_t signature;
+    uint32_t dim;
+    uint32_t nb_labels;
+    uint32_t nb_d0;
+    uint32_t nb_d1;
+    uint32_t flags;
+    uint32_t nb_changes; // of the marking (or FULL_MARKING)
+};
+
+struct _frame_header {
+    uint64_t enabled;
+    uint64_t nb_enabled;
+    uint64_t i, j, k;
+    uint32_t cell;
+    uint32_t phase;
+};
+
+static inline uint64_t _fnv(uint64_t h, uint64_t v) {
+    for (size_t b = 0; b < 8; b++, v >>= 8)
+        h = (h ^ (v & 0xff)) * 0x100000001b3ull;
+    return h;
+}
+
+// the snapshot can only be resumed with the net it was taken from
+static uint64_t _net_fingerprint(struct petri_net* pn) {
+    uint64_t h = _fnv(0xcbf29ce484222325ull, vector_length(pn->marking));
+    size_t* marking = vector_to_array(pn->marking);
+    for (size_t p = 0; p < vector_length(pn->marking); p++)
+        h = _fnv(h, marking[p]);
+    struct pn_transition** transitions = vector_to_array(pn->transitions);
+    h = _fnv(h, vector_length(pn->transitions));
+    for (size_t t = 0; t < vector_length(pn->transitions); t++) {
+        h = _fnv(h, transitions[t]->label_id);
+        struct vector* sets[] = { transitions[t]->preset, transitions[t]->postset };
+        for (size_t s = 0; s < 2; s++) {
+            size_t* places = vector_to_array(sets[s]);
+            h = _fnv(h, vector_length(sets[s]));
+            for (size_t p = 0; p < vector_length(sets[s]); p++)
+                h = _fnv(h, places[p]);
+        }
+    }
+    return h;
+}
+
+static void _marking_of_cell(const struct marking* m, struct cell* c, void* args) {
+    ((const struct marking**) args)[c->id] = m;
+}
+
+static bool _write_stack(FILE* f, struct transition_stack* stack) {
+    size_t* values = transition_stack_array(stack);
+    for (size_t i = 0; i < transition_stack_length(stack); i++) {
+        if (fwrite(&(uint64_t){ values[i] }, sizeof(uint64_t), 1, f) != 1)
+            return false;
+    }
+    return true;
+}
+
+// successive cells are mostly neighbours in the exploration: their markings differ in a few places
+static uint32_t _nb_changes(const struct marking* previous, const struct marking* m) {
+    if (!previous)
+        return FULL_MARKING;
+    uint32_t nb_changes = 0;
+    for (size_t p = 0; p < m->nb_places; p++) {
+        // a change takes 8 bytes
+        if (marking_get(previous, p) != marking_get(m, p) && ++nb_changes * 2 * sizeof(uint32_t) >= (size_t) m->nb_places * m->width)
+            return FULL_MARKING;
+    }
+    return nb_changes;
+}
+
+static bool _write_marking(FILE* f, const struct marking* previous, const struct marking* m, uint32_t nb_changes) {
+    if (nb_changes == FULL_MARKING) {
+        size_t size = (size_t) m->nb_places * m->width;
+        return fwrite(m->counters, 1, size, f) == size;
+    }
+    for (uint32_t p = 0; p < m->nb_places; p++) {
+        uint32_t value = (uint32_t) marking_get(m, p);
+        if (marking_get(previous, p) != value && fwrite(&(uint32_t[2]){ p, value }, sizeof(uint32_t[2]), 1, f) != 1)
+            return false;
+    }
+    return true;
+}
+
+static bool _write(struct _conversion_state* state, struct petri_net* pn, FILE* f) {
+    struct cell_arena* cells = state->hda->cells;
+    size_t nb_cells = cell_arena_length(cells);
+    struct _frame* frames = frame_list_array(&state->frames);
+    size_t nb_frames = frame_list_length(&state->frames);
+    const struct marking** markings = calloc(nb_cells ? nb_cells : 1, sizeof(*markings));
+    if (!markings) {
+        LOG(ERROR, "%s", "Unable to write the checkpoint: not enough memory");
+        return false;
+    }
+    cell_index_forall(state->visited, _marking_of_cell, markings);
+
+    struct _header h = {
+        .version = CHECKPOINT_VERSION,
+        .width = state->scratch->width,
+        .net = _net_fingerprint(pn),
+        .dim_bound = state->dim_bound,
+        .nb_cells = nb_cells,
+        .nb_enabled = enabled_list_length(&state->enabled),
+        .stack_length = transition_stack_length(frames[0].transition_stack),
+        .nb_frames = nb_frames,
+    };
+    memcpy(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic));
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (size_t i = 0; ok && i < nb_cells; i++) {
+        struct cell* c = cell_arena_get(cells, (cell_id) i);
+        if (!(ok = markings[i] != NULL))
+            break;
+        struct _cell_header ch = {
+            .signature = c->signature, .dim = c->dim,
+            .nb_labels = c->labels.length, .nb_d0 = c->d0.length, .nb_d1 = c->d1.length,
+            .flags = *cell_arena_flags(cells, c->id),
+            .nb_changes = _nb_changes(i ? markings[i - 1] : NULL, markings[i]),
+        };
+        ok = fwrite(&ch, sizeof(ch), 1, f) == 1
+            && fwrite(cell_list_array(&c->labels), sizeof(uint32_t), c->labels.length, f) == c->labels.length
+            && fwrite(cell_list_array(&c->d0), sizeof(cell_id), c->d0.length, f) == c->d0.length
+            && fwrite(cell_list_array(&c->d1), sizeof(cell_id), c->d1.length, f) == c->d1.length
+            && _write_marking(f, i ? markings[i - 1] : NULL, markings[i], ch.nb_changes);
+    }
+    struct marking_enabled* enabled = enabled_list_array(&state->enabled);
+    for (size_t i = 0; ok && i < enabled_list_length(&state->enabled); i++)
+        ok = fwrite(&(uint64_t[2]){ enabled[i].transition, enabled[i].count }, sizeof(uint64_t[2]), 1, f) == 1;
+    ok = ok && _write_stack(f, frames[0].transition_stack);
+    for (size_t i = 0; ok && i < nb_frames; i++) {
+        struct _frame_header fh = {
+            .enabled = frames[i].enabled, .nb_enabled = frames[i].nb_enabled,
+            .i = frames[i].i, .j = frames[i].j, .k = frames[i].k,
+            .cell = frames[i].c->id, .phase = frames[i].phase,
+        };
+        uint64_t copy_length = frames[i].copy ? transition_stack_length(frames[i].copy) : NO_COPY;
+        ok = fwrite(&fh, sizeof(fh), 1, f) == 1 && fwrite(&copy_length, sizeof(copy_length), 1, f) == 1
+            && (!frames[i].copy || _write_stack(f, frames[i].copy));
+    }
+    free(markings);
+    return ok;
+}
+
+bool conversion_checkpoint_write(struct _conversion_state* state, struct petri_net* pn, const char* path) {
+    if (frame_list_is_empty(&state->frames))
+        return false;
+    size_t length = strlen(path);
+    char* tmp = malloc(length + sizeof(".tmp"));
+    if (!tmp) {
+        LOG(ERROR, "%s", "Unable to write the checkpoint: not enough memory");
+        return false;
+    }
+    memcpy(tmp, path, length);
+    memcpy(tmp + length, ".tmp", sizeof(".tmp"));
+    FILE* f = fopen(tmp, "wb");
+    bool ok = f && _write(state, pn, f);
+    ok = f && !fclose(f) && ok;
+    // the previous snapshot is only replaced by a complete one
+    if (!ok || rename(tmp, path)) {
+        LOG(ERROR, "Unable to write the checkpoint `%s'", path);
+        remove(tmp);
+        ok = false;
+    }
+    free(tmp);
+    return ok;
+}
+
+static bool _read_stack(FILE* f, struct transition_stack* stack, size_t length, size_t nb_transitions) {
+    if (!transition_stack_reserve(stack, length))
+        return false;
+    for (size_t i = 0; i < length; i++) {
+        uint64_t v;
+        if (fread(&v, sizeof(v), 1, f) != 1 || v >= nb_transitions || !transition_stack_push(stack, v))
+            return false;
+    }
+    return true;
+}
+
+static bool _read_ids(FILE* f, struct cell_list* l, uint32_t length, struct id_pool* pool, uint64_t bound) {
+    for (uint32_t i = 0; i < length; i++) {
+        uint32_t id;
+        if (fread(&id, sizeof(id), 1, f) != 1 || id >= bound || !cell_list_push(l, id, pool))
+            return false;
+    }
+    return true;
+}
+
+// the scratch marking m holds the marking of the previous cell
+static bool _read_marking(FILE* f, struct marking* m, uint32_t nb_changes, size_t cell) {
+    if (nb_changes == FULL_MARKING) {
+        size_t size = (size_t) m->nb_places * m->width;
+        return fread(m->counters, 1, size, f) == size;
+    }
+    if (!cell)
+        return false;
+    for (uint32_t i = 0; i < nb_changes; i++) {
+        uint32_t change[2];
+        if (fread(change, sizeof(change), 1, f) != 1 || change[0] >= m->nb_places)
+            return false;
+        switch (m->width) {
+            case 1:
+                if (change[1] > UINT8_MAX) return false;
+                m->counters[change[0]] = (uint8_t) change[1];
+                break;
+            case 2: {
+                if (change[1] > UINT16_MAX) return false;
+                uint16_t v = (uint16_t) change[1];
+                memcpy(m->counters + 2 * (size_t) change[0], &v, sizeof(v));
+                break;
+            }
+            default:
+                memcpy(m->counters + 4 * (size_t) change[0], &change[1], sizeof(uint32_t));
+                break;
+        }
+    }
+    return true;
+}
+
+static bool _read_cells(struct _conversion_state* state, FILE* f, struct _header* h, struct marking** markings, size_t nb_labels) {
+    struct marking* m = state->scratch;
+    for (size_t i = 0; i < h->nb_cells; i++) {
+        struct _cell_header ch;
+        if (fread(&ch, sizeof(ch), 1, f) != 1 || ch.nb_labels != ch.dim)
+            return false;
+        struct cell* c = cell_arena_alloc(state->hda->cells, ch.dim, state->pool);
+        if (!c) {
+            LOG(FATAL, "%s", "not enough memory");
+            exit(1); // FIXME error handling
+        }
+        c->signature = ch.signature;
+        STATS_HISTOGRAM(cells_per_dim, (size_t) ch.dim + 1);
+        // cells streamed by the previous run are streamed again
+        *cell_arena_flags(state->hda->cells, c->id) = (uint8_t)(ch.flags & ~CONVERSION_CELL_STREAMED);
+        if (!_read_ids(f, &c->labels, ch.nb_labels, state->pool, nb_labels)
+            || !_read_ids(f, &c->d0, ch.nb_d0, state->pool, h->nb_cells)
+            || !_read_ids(f, &c->d1, ch.nb_d1, state->pool, h->nb_cells)
+            || !_read_marking(f, m, ch.nb_changes, i))
+            return false;
+        marking_rehash(m);
+        // cells are added in creation order: the cells sharing a key are found in the same order
+        markings[i] = conversion_commit_marking(state->arena, m);
+        if (!cell_index_add(state->visited, markings[i], c)) {
+            LOG(FATAL, "%s", "not enough memory");
+            exit(1); // FIXME error handling
+        }
+    }
+    // adjacency filters, once the cells referenced by the lists all exist
+    for (size_t i = 0; i < h->nb_cells; i++) {
+        struct cell* c = cell_arena_get(state->hda->cells, (cell_id) i);
+        for (size_t j = 0; j < c->d0.length; j++)
+            cell_adjacency_add(c, cell_arena_get(state->hda->cells, cell_list_array(&c->d0)[j]));
+        for (size_t j = 0; j < c->d1.length; j++)
+            cell_adjacency_add(c, cell_arena_get(state->hda->cells, cell_list_array(&c->d1)[j]));
+    }
+    return true;
+}
+
+static bool _read_frames(struct _conversion_state* state, FILE* f, struct _header* h, struct marking** markings,
+                         struct transition_stack* t_stack, size_t nb_transitions) {
+    for (size_t i = 0; i < h->nb_frames; i++) {
+        struct _frame_header fh;
+        uint64_t copy_length;
+        if (fread(&fh, sizeof(fh), 1, f) != 1 || fread(&copy_length, sizeof(copy_length), 1, f) != 1)
+            return false;
+        if (fh.cell >= h->nb_cells || fh.phase > FRAME_END || fh.enabled > h->nb_enabled || fh.nb_enabled > h->nb_enabled - fh.enabled)
+            return false;
+        struct _frame fr = {
+            .m = markings[fh.cell], .c = cell_arena_get(state->hda->cells, fh.cell),
+            .enabled = fh.enabled, .nb_enabled = fh.nb_enabled,
+            .i = fh.i, .j = fh.j, .k = fh.k,
+            .phase = fh.phase == FRAME_START ? FRAME_START : FRAME_END,
+        };
+        // the stack of a frame is the one of its parent, or the copy of its parent in end phase
+        if (!i) {
+            fr.transition_stack = t_stack;
+        } else {
+            struct _frame* parent = frame_list_last(&state->frames);
+            fr.transition_stack = parent->phase == FRAME_START ? parent->transition_stack : parent->copy;
+            if (!fr.transition_stack)
+                return false;
+        }
+        bool ok = true;
+        if (copy_length != NO_COPY) {
+            if ((fr.copy = malloc(sizeof(*fr.copy))))
+                transition_stack_init(fr.copy);
+            ok = fr.copy && _read_stack(f, fr.copy, copy_length, nb_transitions);
+        }
+        if (!frame_list_push(&state->frames, fr)) {
+            if (fr.copy) conversion_stack_free(fr.copy);
+            return false;
+        }
+        if (!ok)
+            return false;
+    }
+    return true;
+}
+
+bool conversion_checkpoint_read(struct _conversion_state* state, struct petri_net* pn, const char* path, struct transition_stack* t_stack) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        LOG(ERROR, "Cannot open checkpoint `%s'", path);
+        return false;
+    }
+    struct _header h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic)) || h.version != CHECKPOINT_VERSION) {
+        LOG(ERROR, "`%s' is not a checkpoint of this version of pn2hda", path);
+        fclose(f);
+        return false;
+    }
+    if (h.net != _net_fingerprint(pn) || h.width != state->scratch->width) {
+        LOG(ERROR, "The checkpoint `%s' was not taken from this net", path);
+        fclose(f);
+        return false;
+    }
+    if (h.dim_bound != state->dim_bound) {
+        if (h.dim_bound)
+            LOG(ERROR, "The checkpoint `%s' was taken with --max-dim %zu", path, (size_t) h.dim_bound - 1);
+        else
+            LOG(ERROR, "The checkpoint `%s' was taken without --max-dim", path);
+        fclose(f);
+        return false;
+    }
+    size_t nb_transitions = vector_length(pn->transitions);
+    struct marking** markings = malloc((h.nb_cells ? h.nb_cells : 1) * sizeof(*markings));
+    if (!markings) {
+        LOG(FATAL, "%s", "not enough memory");
+        exit(1); // FIXME error handling
+    }
+    bool ok = h.nb_cells && h.nb_frames && _read_cells(state, f, &h, markings, vector_length(pn->labels));
+    for (size_t i = 0; ok && i < h.nb_enabled; i++) {
+        uint64_t e[2];
+        ok = fread(e, sizeof(e), 1, f) == 1 && e[0] < nb_transitions
+            && enabled_list_push(&state->enabled, (struct marking_enabled){ e[0], e[1] });
+    }
+    ok = ok && _read_stack(f, t_stack, h.stack_length, nb_transitions)
+        && _read_frames(state, f, &h, markings, t_stack, nb_transitions);
+    ok = ok && fgetc(f) == EOF;
+    if (!ok)
+        LOG(ERROR, "The checkpoint `%s' is truncated or corrupted", path);
+    else
+        LOG(INFO, "Resumed from `%s': %zu cells, %zu pending frames", path, (size_t) h.nb_cells, (size_t) h.nb_frames);
+    free(markings);
+    fclose(f);
+    return ok;
+}
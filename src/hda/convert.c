@@ -1,244 +1,483 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include "logger.h"
 #include "hda.h"
 #include "petri_nets.h"
 #include "vector.h"
-#include "hashtbl.h"
+#include "cell_index.h"
 #include "pair.h"
+#include "conversion.h"
+#include "marking.h"
+#include "hda_writer.h"
+#include "stats.h"
 
-struct _current_pn_state {
-    struct vector* transition_stack;
-    struct vector* pn_transitions;
-    struct cell* current_cell;
-    bool is_d0;
-};
-
-static bool _filter_hashtbl_elm(void* value, void* extra_args) {
+static bool _filter_cell(void* value, void* extra_args) {
     struct cell* c = value;
-    struct _current_pn_state* pn_state = extra_args;
-    // verifie cell found not full
-    if (c->dim && pn_state->is_d0 && vector_length(c->d0) >= c->dim) return false;
-    if (!pn_state->current_cell->dim && pn_state->is_d0 && vector_length(pn_state->current_cell->d1) >= 2) return false;
-    if (!c->dim && !pn_state->is_d0 && vector_length(c->d0) >= 2) return false;
-    // verifie c not in current_cell.(d0 U d1) and current_cell not in c.(d0 U d1)
-    for (size_t i = 0; i < vector_length(c->d0); i++) {
-        if (((struct cell**)vector_to_array(c->d0))[i] == pn_state->current_cell)
-            return false;
-    }
-    for (size_t i = 0; i < vector_length(c->d1); i++) {
-        if (((struct cell**)vector_to_array(c->d1))[i] == pn_state->current_cell)
-            return false;
-    }
-    for (size_t i = 0; i < vector_length(pn_state->current_cell->d0); i++) {
-        if (((struct cell**)vector_to_array(pn_state->current_cell->d0))[i] == c)
-            return false;
-    }
-    for (size_t i = 0; i < vector_length(pn_state->current_cell->d1); i++) {
-        if (((struct cell**)vector_to_array(pn_state->current_cell->d1))[i] == c)
-            return false;
-    }
-    // verifie cell found has correct labels
-    if (!c->labels)
-        return vector_length(pn_state->transition_stack) == 0;
-    if (vector_length(pn_state->transition_stack) != vector_length(c->labels))
-        return false;
-    for (size_t i = 0; i < vector_length(pn_state->transition_stack); i++) {
-        long count = 1;
-        const char* cur_label = ((struct pn_transition**)vector_to_array(pn_state->pn_transitions))[((size_t*)vector_to_array(pn_state->transition_stack))[i]]->label;
-        for (size_t k = 0; k < vector_length(pn_state->transition_stack); k++) {
-            if (k != i && !strcmp(cur_label,
-                                  ((struct pn_transition**)vector_to_array(pn_state->pn_transitions))[((size_t*)vector_to_array(pn_state->transition_stack))[k]]->label))
-                count++;
-        }
-        for (size_t k = 0; k < vector_length(c->labels); k++) {
-            if (!strcmp(cur_label, ((char**)vector_to_array(c->labels))[k])) {
-                if (!count) return false;
-                count--;
-            }
+    struct cell* current = extra_args;
+    // (the cells found are not full: see cell_index_find and conversion_may_reuse)
+    // verifie c not in current_cell.(d0 U d1) and current_cell not in c.(d0 U d1):
+    // the dimensions of the cells differ by 1 and only the lists of the higher one are looked up
+    // (see cell_adjacency_add), in O(1) (see cell_list_contains), if its adjacency filter has the
+    // bits of the lower one
+    if (!cell_may_be_adjacent(c, current))
+        return true;
+    STATS_INC(filter_probes);
+    struct cell* higher = c->dim > current->dim ? c : current;
+    cell_id lower = higher == c ? current->id : c->id;
+    return !cell_list_contains(&higher->d0, lower) && !cell_list_contains(&higher->d1, lower);
+}
+
+bool conversion_filter_cell(void* value, void* extra_args) {
+    bool accepted = _filter_cell(value, extra_args);
+    STATS_INC(filter_calls);
+    if (!accepted)
+        STATS_INC(filter_rejections);
+    return accepted;
+}
+
+struct transition_stack* conversion_stack_copy(struct transition_stack* stack, size_t skip) {
+    struct transition_stack* copy = malloc(sizeof(*copy));
+    size_t length = transition_stack_length(stack);
+    size_t* transitions = transition_stack_array(stack);
+    if (copy)
+        transition_stack_init(copy);
+    if (!copy || !transition_stack_reserve(copy, length)
+        || !transition_stack_append_n(copy, transitions, skip < length ? skip : length)
+        || (skip < length && !transition_stack_append_n(copy, transitions + skip + 1, length - skip - 1))) {
+        LOG(FATAL, "%s", "not enough memory");
+        exit(1); // FIXME error handling
+    }
+    return copy;
+}
+
+void conversion_stack_free(struct transition_stack* stack) {
+    transition_stack_destroy(stack);
+    free(stack);
+}
+
+size_t conversion_labels(struct vector* pn, struct transition_stack* transition_stack, struct label_list* labels) {
+    struct pn_transition** transitions = vector_to_array(pn);
+    size_t* stack = transition_stack_array(transition_stack);
+    size_t length = transition_stack_length(transition_stack);
+    label_list_clear(labels);
+    if (!label_list_reserve(labels, length)) {
+        LOG(FATAL, "%s", "not enough memory");
+        exit(1); // FIXME error handling
+    }
+    uint32_t* ids = label_list_array(labels);
+    for (size_t i = 0; i < length; i++) {
+        ids[i] = (uint32_t) transitions[stack[i]]->label_id;
+        // insertion sort: the stack is as small as the dimension of the cell
+        for (size_t k = i; k > 0 && ids[k - 1] > ids[k]; k--) {
+            uint32_t tmp = ids[k];
+            ids[k] = ids[k - 1];
+            ids[k - 1] = tmp;
         }
-        if (count) return false;
     }
-    return true;
+    labels->length = length;
+    return cell_labels_signature(ids, length);
 }
 
-static struct cell* _conversion(struct vector* m,
-                                struct vector* transition_stack, // stack of activated transition
-                                struct vector* pn, // transition part
-                                struct hda* hda,
-                                struct hashtbl* hashtbl,
-                                struct cell* S, struct cell* T) {
+// push the id of other in the list l of c
+static inline void _push(struct cell* c, struct cell_list* l, struct cell* other, struct id_pool* pool) {
+    if (!cell_list_push(l, other->id, pool)) {
+        LOG(FATAL, "%s", "not enough memory");
+        exit(1); // FIXME error handling
+    }
+    cell_adjacency_add(c, other);
+}
 
+struct cell* conversion_new_cell(struct cell_arena* arena, struct id_pool* pool, struct label_list* labels, size_t signature, struct cell* S, struct cell* T) {
     // dimension of the cell
-    size_t d = vector_length(transition_stack);
+    size_t d = label_list_length(labels);
 
-    struct cell* c = init_cell(d);
+    struct cell* c = cell_arena_alloc(arena, (uint32_t) d, pool);
     if (!c) {
         LOG(FATAL, "%s", "not enough memory");
         exit(1); // FIXME error handling
     }
+    STATS_HISTOGRAM(cells_per_dim, d + 1);
 
     if (S) {
         // push Start as unstart of the actual cell
-        if (!vector_push(c->d0, &S)) {
-            LOG(FATAL, "%s", "not enough memory");
-            exit(1); // FIXME error handling
-        }
+        _push(c, &c->d0, S, pool);
     }
     if (S && !S->dim) {
         // push ougoing edge (current cell) in d1 of vertex S
-        if (!vector_push(S->d1, &c)) {
-            LOG(FATAL, "%s", "not enough memory");
-            exit(1); // FIXME error handling
-        }
+        _push(S, &S->d1, c, pool);
     }
     if(T) {
         // add the actual cell in terminated of the Terminated cell
-        if (!vector_push(T->d1, &c)) {
-            LOG(FATAL, "%s", "not enough memory");
-            exit(1); // FIXME error handling
-        }
+        _push(T, &T->d1, c, pool);
     }
     if (T && !d) {
         // push the incomming edge (T) in d0 of current vertex
-        if (!vector_push(c->d0, &T)) {
-            LOG(FATAL, "%s", "not enough memory");
-            exit(1); // FIXME error handling
-        }
+        _push(c, &c->d0, T, pool);
     }
 
     // add labels of currently activated transitions in the cell
-    for (size_t i = 0; i < vector_length(transition_stack); i++) {
-        // labels
-        if (!vector_push(c->labels, &(((struct pn_transition**)vector_to_array(pn))[(((size_t*)vector_to_array(transition_stack))[i])]->label))) {
-            LOG(FATAL, "%s", "not enough memory");
-            exit(1); // FIXME error handling
+    memcpy(cell_list_array(&c->labels), label_list_array(labels), d * sizeof(uint32_t));
+    c->labels.length = (uint32_t) d;
+    c->signature = signature;
+    return c;
+}
+
+void conversion_link_started(struct cell* c, struct cell* c1, struct id_pool* pool) {
+    // push actual cell as unstart of the reached one
+    _push(c1, &c1->d0, c, pool);
+    if (!c->dim) {
+        // push ougoing edge (current cell) in d1 of vertex S
+        _push(c, &c->d1, c1, pool);
+    }
+}
+
+void conversion_link_ended(struct cell* c, struct cell* c1, struct id_pool* pool) {
+    // add the reached cell in terminated of the current one
+    _push(c, &c->d1, c1, pool);
+    if (!c1->dim) {
+        // push the incomming edge (T) in d0 of current vertex
+        _push(c1, &c1->d0, c, pool);
+    }
+}
+
+struct marking* conversion_commit_marking(struct marking_arena* arena, const struct marking* m) {
+    struct marking* out = marking_arena_commit(arena, m);
+    if (!out) {
+        LOG(FATAL, "%s", "not enough memory");
+        exit(1); // FIXME error handling
+    }
+    return out;
+}
+
+struct marking* conversion_initial_marking(struct petri_net* pn, struct marking_arena* arena, struct marking* scratch) {
+    if (!marking_from_vector(scratch, pn->marking)) {
+        LOG(FATAL, "%s", "initial marking does not fit in the marking counters");
+        exit(1);
+    }
+    struct pn_transition** transitions = vector_to_array(pn->transitions);
+    for (size_t i = 0; i < vector_length(pn->transitions); i++) {
+        if (vector_is_empty(transitions[i]->preset))
+            LOG(WARNING, "Transition `%s' has no input place: it is never started", transitions[i]->label);
+    }
+    return conversion_commit_marking(arena, scratch);
+}
+
+// compute in state->next the enabled transitions of the successor of frame f whose places were modified
+static void _successor_enabled(struct _conversion_state* state, struct _frame* f, struct vector* places, struct marking* m) {
+    struct marking_enabled* parent = enabled_list_array(&state->enabled) + f->enabled;
+    if (!marking_enabled_update(state->consumers, parent, f->nb_enabled, places, m, &state->touched, &state->next)) {
+        LOG(FATAL, "%s", "not enough memory");
+        exit(1); // FIXME error handling
+    }
+}
+
+bool conversion_stream_ready(struct cell_arena* arena, struct cell* c, bool done) {
+    uint8_t* flags = cell_arena_flags(arena, c->id);
+    if (done)
+        *flags |= CONVERSION_CELL_DONE;
+    if (!(*flags & CONVERSION_CELL_DONE) || (*flags & CONVERSION_CELL_STREAMED) || c->d0.length < c->dim)
+        return false;
+    *flags |= CONVERSION_CELL_STREAMED;
+    return true;
+}
+
+void conversion_stream_rest(struct cell_arena* arena, struct hda_writer* writer) {
+    for (size_t i = 0; i < cell_arena_length(arena); i++) {
+        uint8_t* flags = cell_arena_flags(arena, (cell_id) i);
+        if (!(*flags & CONVERSION_CELL_STREAMED)) {
+            *flags |= CONVERSION_CELL_STREAMED;
+            hda_writer_push(writer, cell_arena_get(arena, (cell_id) i));
         }
     }
+}
+
+// current resident memory of the process in bytes (the peak one where it cannot be read)
+static size_t _resident_memory(void) {
+#ifdef __linux__
+    FILE* f = fopen("/proc/self/statm", "r");
+    size_t size, resident;
+    bool ok = f && fscanf(f, "%zu %zu", &size, &resident) == 2;
+    if (f)
+        fclose(f);
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (ok && page_size > 0)
+        return resident * (size_t) page_size;
+#endif // __linux__
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) ? 0 : (size_t) usage.ru_maxrss * 1024;
+}
 
-    // add cell in the HDA
-    if (!vector_push(hda->cells, &c)) {
+void conversion_budget_init(struct conversion_budget* b, struct conversion_options options) {
+    *b = (struct conversion_budget){ .memory_limit = options.memory_limit };
+    if (b->memory_limit)
+        b->memory_base = _resident_memory();
+    if (options.time_limit > 0 && !clock_gettime(CLOCK_MONOTONIC, &b->deadline)) {
+        double seconds = (double) b->deadline.tv_sec + b->deadline.tv_nsec / 1e9 + options.time_limit;
+        b->deadline.tv_sec = (time_t) seconds;
+        b->deadline.tv_nsec = (long)((seconds - (double) b->deadline.tv_sec) * 1e9);
+        b->has_deadline = true;
+    }
+}
+
+enum conversion_status conversion_budget_read(struct conversion_budget* b) {
+    struct timespec now;
+    if (b->has_deadline && !clock_gettime(CLOCK_MONOTONIC, &now)
+        && (now.tv_sec > b->deadline.tv_sec || (now.tv_sec == b->deadline.tv_sec && now.tv_nsec >= b->deadline.tv_nsec)))
+        return CONVERSION_TIME_LIMIT;
+    // memory gained since the conversion started: the previous conversions of a batch are not counted
+    size_t resident;
+    if (b->memory_limit && (resident = _resident_memory()) > b->memory_base && resident - b->memory_base >= b->memory_limit)
+        return CONVERSION_MEMORY_LIMIT;
+    return CONVERSION_COMPLETE;
+}
+
+void conversion_budget_log(enum conversion_status status, __attribute__((unused))struct conversion_options options) {
+    if (status == CONVERSION_TIME_LIMIT)
+        LOG(TIMEOUT, "Time limit of %gs reached: the exploration stops", options.time_limit);
+    else if (status == CONVERSION_MEMORY_LIMIT)
+        LOG(TIMEOUT, "Memory limit of %zu bytes reached: the exploration stops", options.memory_limit);
+}
+
+// create the cell for marking m (labels of the cell in state->labels, enabled transitions
+// of m in state->next) and push the frame that will explore it
+static void _enter_cell(struct _conversion_state* state,
+                        struct marking* m,
+                        struct transition_stack* transition_stack, // stack of activated transition
+                        struct cell* S, struct cell* T) {
+    struct cell* c = conversion_new_cell(state->hda->cells, state->pool, &state->labels, state->signature, S, T);
+
+    // add (marking, labels, cell) in the visited index
+    if (!cell_index_add(state->visited, m, c)) {
         LOG(FATAL, "%s", "not enough memory");
         exit(1); // FIXME error handling
     }
 
-    // add (marking, cell) in the hashtbl
-    if (!hashtbl_add(hashtbl, m, c, false)) {
+    struct _frame f = {
+        .m = m, .transition_stack = transition_stack, .c = c,
+        .enabled = enabled_list_length(&state->enabled), .nb_enabled = enabled_list_length(&state->next),
+        .i = 0, .j = 0, .k = 0, .copy = NULL,
+        .phase = FRAME_START,
+    };
+    if (!enabled_list_append_n(&state->enabled, enabled_list_array(&state->next), f.nb_enabled)
+        || !frame_list_push(&state->frames, f)) {
         LOG(FATAL, "%s", "not enough memory");
         exit(1); // FIXME error handling
     }
+    STATS_MAX(max_depth, frame_list_length(&state->frames));
+}
 
-    // for all transition in the PN
-    for (size_t i = 0; i < vector_length(pn); i++) {
+// write a checkpoint if the interval since the last one is elapsed
+static void _checkpoint_if_due(struct _conversion_state* state) {
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) || now.tv_sec < state->next_checkpoint.tv_sec
+        || (now.tv_sec == state->next_checkpoint.tv_sec && now.tv_nsec < state->next_checkpoint.tv_nsec))
+        return;
+    if (conversion_checkpoint_write(state, state->net, state->checkpoint))
+        LOG(INFO, "Checkpoint written in `%s': %zu cells", state->checkpoint, cell_arena_length(state->hda->cells));
+    clock_gettime(CLOCK_MONOTONIC, &state->next_checkpoint);
+    state->next_checkpoint.tv_sec += (time_t) state->checkpoint_interval;
+}
 
-        size_t is_activable = pn_transition_is_activable(pn, m, i);
-        for (size_t j = 0; j < is_activable; j++) {
-            // try to start a transition (is_activable)
-            struct vector* m2 = pn_start_transition(pn, m, i);
-            // FIXME: Error handling in pn_start_transition not enough memory
+// Run the frames of the stack until it is empty (or a budget is reached).
+// The exploration order is the one of a recursive depth first search, but the pending
+// calls live in a heap allocated stack of frames so the depth is only bounded by memory,
+// and the whole exploration state can be saved and restored (see conversion_checkpoint_write).
+static void _explore(struct _conversion_state* state) {
+    struct vector* pn = state->pn;
+    struct frame_list* frames = &state->frames;
+    while (!frame_list_is_empty(frames)) {
+        enum conversion_status status = conversion_budget_step(&state->budget);
+        if (state->checkpoint && !(state->budget.steps % CONVERSION_BUDGET_PERIOD))
+            _checkpoint_if_due(state);
+        if (status != CONVERSION_COMPLETE) {
+            // the exploration can be resumed from a last checkpoint
+            if (state->checkpoint && conversion_checkpoint_write(state, state->net, state->checkpoint))
+                LOG(INFO, "Checkpoint written in `%s': %zu cells", state->checkpoint, cell_arena_length(state->hda->cells));
+            // the cells of the frames are the frontier: every other cell is done
+            state->hda->status = status;
+            state->hda->nb_unexplored = frame_list_length(frames);
+            struct _frame* f = frame_list_array(frames);
+            for (size_t i = 0; i < frame_list_length(frames); i++) {
+                if (f[i].copy)
+                    conversion_stack_free(f[i].copy);
+            }
+            frame_list_clear(frames);
+            break;
+        }
+        // the frame pointer is invalidated by _enter_cell (frames may be reallocated)
+        struct _frame* f = frame_list_last(frames);
+        struct cell* c = f->c;
+        size_t d = c->dim;
 
-            // if transition activable (and started successfully)
-            if (m2) {
-                if (!vector_push(transition_stack, &i)) {
+        if (f->phase == FRAME_START) {
+            // for all transition enabled in m (none is started at the dimension bound)
+            if (f->i >= f->nb_enabled || d + 1 == state->dim_bound) {
+                f->phase = FRAME_END;
+                continue;
+            }
+            struct marking_enabled e = enabled_list_array(&state->enabled)[f->enabled + f->i];
+            if (f->j >= e.count) {
+                f->i++;
+                f->j = 0;
+                continue;
+            }
+            f->j++;
+            size_t i = e.transition;
+            struct pn_transition* t = ((struct pn_transition**)vector_to_array(pn))[i];
+
+            // try to start a transition (is_activable) in the scratch marking
+            if (marking_start_transition(t, f->m, state->scratch)) {
+                if (!transition_stack_push(f->transition_stack, i)) {
                     LOG(FATAL, "%s", "not enough memory");
                     exit(1); // FIXME error handling
                 }
                 // see if already known cell
-                struct hashtbl_element e = hashtbl_find_filter(hashtbl, m2, _filter_hashtbl_elm, &(struct _current_pn_state) { transition_stack, pn, c, true });
-                struct cell* c1 = e.value;
-                if (e.key == NULL || e.value == NULL) {
-                    // if not already known, add transition i in stack + rec call + remove i from stack
-                    c1 = _conversion(m2, transition_stack, pn, hda, hashtbl, c, NULL);
+                state->signature = conversion_labels(pn, f->transition_stack, &state->labels);
+                struct cell* c1 = !conversion_may_reuse(c, true) ? NULL
+                    : cell_index_find(state->visited, &(struct cell_key){ state->scratch, label_list_array(&state->labels), label_list_length(&state->labels), state->signature },
+                                      true, conversion_filter_cell, c);
+                STATS_INC(successors);
+                if (!c1) {
+                    STATS_INC(new_successors);
+                    // if not already known, explore it with transition i in stack
+                    // (i is removed from the stack once the new frame is done)
+                    struct marking* m2 = conversion_commit_marking(state->arena, state->scratch);
+                    _successor_enabled(state, f, t->preset, m2);
+                    _enter_cell(state, m2, f->transition_stack, c, NULL);
+                    continue;
                 } else {
-                    // push actual cell as unstart of the reached one
-                    if (!vector_push(c1->d0, &c)) {
-                        LOG(FATAL, "%s", "not enough memory");
-                        exit(1); // FIXME error handling
-                    }
-                    if (!d) {
-                        // push ougoing edge (current cell) in d1 of vertex S
-                        if (!vector_push(c->d1, &c1)) {
-                            LOG(FATAL, "%s", "not enough memory");
-                            exit(1); // FIXME error handling
-                        }
-                    }
-                    vector_destroy(m2);
+                    conversion_link_started(c, c1, state->pool);
+                    if (state->writer && conversion_stream_ready(state->hda->cells, c1, false))
+                        hda_writer_push(state->writer, c1);
                 }
-                vector_pop(transition_stack);
+                transition_stack_pop(f->transition_stack);
             }
+            continue;
+        }
+
+        // if we have some transition activated
+        // iterate over the transition stack to terminate each one
+        if (f->k >= d) {
+            enabled_list_truncate(&state->enabled, f->enabled);
+            frame_list_pop(frames);
+            if (state->writer && conversion_stream_ready(state->hda->cells, c, true))
+                hda_writer_push(state->writer, c);
+            // the parent frame was waiting for this cell: resume it
+            if (!frame_list_is_empty(frames)) {
+                struct _frame* parent = frame_list_last(frames);
+                if (parent->phase == FRAME_START) {
+                    transition_stack_pop(parent->transition_stack);
+                } else {
+                    conversion_stack_free(parent->copy);
+                    parent->copy = NULL;
+                    parent->k++;
+                }
+            }
+            continue;
         }
-    }
 
-    // if we have some transition activated
-    // iterate over the transition stack to terminate each one
-    for (size_t k = 0; k < d; k++) {
-        size_t t = ((size_t*)vector_to_array(transition_stack))[k];
+        struct pn_transition* t = ((struct pn_transition**)vector_to_array(pn))[transition_stack_array(f->transition_stack)[f->k]];
 
         // copy the transition stack state without the ended transition
-        struct vector* copy = vector_new(sizeof(size_t), vector_length(transition_stack)-1);
-        for (size_t i = 0; i < d; i++) {
-            if (i != k) vector_push(copy, &(((size_t*)vector_to_array(transition_stack))[i]));
-        }
+        f->copy = conversion_stack_copy(f->transition_stack, f->k);
 
-        // end that transition in the marking
-        struct vector* m2 = pn_end_transition(pn, m, t);
-        // FIXME: Error handling in pn_end_transition not enough memory
-        if (!m2) {
-            LOG(FATAL, "%s", "not enough memory");
-            exit(1); // FIXME error handling
+        // end that transition in the scratch marking
+        if (!marking_end_transition(t, f->m, state->scratch)) {
+            LOG(FATAL, "%s", "place counter overflow: the net is not bounded");
+            exit(1);
         }
 
         // see if reachable marking refer to a known cell
-        struct hashtbl_element e = hashtbl_find_filter(hashtbl, m2, _filter_hashtbl_elm, &(struct _current_pn_state){ copy, pn, c, false });
-        struct cell* c1 = e.value;
-        if (e.key == NULL || e.value == NULL) {
-            // if not do a rec call
-            c1 = _conversion(m2, copy, pn, hda, hashtbl, NULL, c);
+        state->signature = conversion_labels(pn, f->copy, &state->labels);
+        struct cell* c1 = cell_index_find(state->visited, &(struct cell_key){ state->scratch, label_list_array(&state->labels), label_list_length(&state->labels), state->signature },
+                                          d == 1, conversion_filter_cell, c);
+        STATS_INC(successors);
+        if (!c1) {
+            STATS_INC(new_successors);
+            // if not explore it (copy is released once the new frame is done)
+            struct marking* m2 = conversion_commit_marking(state->arena, state->scratch);
+            _successor_enabled(state, f, t->postset, m2);
+            _enter_cell(state, m2, f->copy, NULL, c);
+            continue;
         } else {
-            // add the reached cell in terminated of the current one
-            if (!vector_push(c->d1, &c1)) {
-                LOG(FATAL, "%s", "not enough memory");
-                exit(1); // FIXME error handling
-            }
-            if (!c1->dim) {
-                // push the incomming edge (T) in d0 of current vertex
-                if (!vector_push(c1->d0, &c)) {
-                    LOG(FATAL, "%s", "not enough memory");
-                    exit(1); // FIXME error handling
-                }
-            }
-            vector_destroy(m2);
+            conversion_link_ended(c, c1, state->pool);
         }
 
-        vector_destroy(copy);
+        conversion_stack_free(f->copy);
+        f->copy = NULL;
+        f->k++;
     }
-
-    // return the current cell
-    return c;
 }
 
-static inline size_t marking_cmp(const void* m1, const void* m2) {
-    return !is_same_marking((struct vector*)m1, (struct vector*)m2);
-}
-
-static inline void free_markings_hashtbl(struct hashtbl_element e, __attribute__((unused))void* unused) {
-    vector_destroy(e.key);
+// Explore the state space from the initial marking m.
+static void _conversion(struct _conversion_state* state, struct marking* m, struct transition_stack* transition_stack) {
+    state->signature = conversion_labels(state->pn, transition_stack, &state->labels);
+    if (!marking_enabled_all(state->consumers, m, &state->next)) {
+        LOG(FATAL, "%s", "not enough memory");
+        exit(1); // FIXME error handling
+    }
+    _enter_cell(state, m, transition_stack, NULL, NULL);
+    _explore(state);
 }
 
-struct hda* conversion(struct petri_net* pn) {
-    struct hda* out = init_hda();
-    Hashtbl(Vector(size_t), struct cell*) h;
-    HASHTBL_NEW(h, Vector(size_t), struct cell*, .cmp_func = marking_cmp, .hash_func = marking_hash);
-    Vector(size_t) t_stack = vector_new(sizeof(size_t), 0);
-    if (!out || !t_stack || !h) {
+struct hda* conversion(struct petri_net* pn, struct conversion_options options) {
+    struct _conversion_state state = {
+        .net = pn,
+        .pn = pn->transitions,
+        .hda = init_hda(),
+        .writer = options.writer,
+        .dim_bound = options.dim_bound,
+        .checkpoint = options.checkpoint,
+        .checkpoint_interval = options.checkpoint_interval,
+        .arena = marking_arena_new(vector_length(pn->marking), marking_width_for_net(pn)),
+        .consumers = marking_consumers_new(pn),
+    };
+    state.visited = cell_index_new();
+    conversion_budget_init(&state.budget, options);
+    state.pool = state.hda ? cell_arena_new_pool(state.hda->cells) : NULL;
+    state.scratch = state.arena ? marking_scratch_new(state.arena) : NULL;
+    label_list_init(&state.labels);
+    enabled_list_init(&state.enabled);
+    enabled_list_init(&state.next);
+    index_list_init(&state.touched);
+    frame_list_init(&state.frames);
+    struct transition_stack t_stack;
+    transition_stack_init(&t_stack);
+    if (!state.hda || !state.arena || !state.consumers || !state.visited || !state.pool || !state.scratch) {
         LOG(FATAL, "%s", "not enough memory");
         exit(1); // FIXME error handling
     }
-    _conversion(marking_copy(pn->marking), t_stack, pn->transitions, out, h, NULL, NULL);
-    vector_destroy(t_stack);
-    hashtbl_forall(h, free_markings_hashtbl, NULL);
-    hashtbl_destroy(h);
-    return out;
+    if (state.checkpoint) {
+        clock_gettime(CLOCK_MONOTONIC, &state.next_checkpoint);
+        state.next_checkpoint.tv_sec += (time_t) state.checkpoint_interval;
+    }
+    if (!options.resume) {
+        _conversion(&state, conversion_initial_marking(pn, state.arena, state.scratch), &t_stack);
+    } else if (conversion_checkpoint_read(&state, pn, options.resume, &t_stack)) {
+        _explore(&state);
+    } else {
+        LOG(FATAL, "Unable to resume the exploration from `%s'", options.resume);
+        exit(1); // FIXME error handling
+    }
+    conversion_budget_log(state.hda->status, options);
+    if (state.writer)
+        conversion_stream_rest(state.hda->cells, state.writer);
+    transition_stack_destroy(&t_stack);
+    frame_list_destroy(&state.frames);
+    label_list_destroy(&state.labels);
+    enabled_list_destroy(&state.enabled);
+    enabled_list_destroy(&state.next);
+    index_list_destroy(&state.touched);
+    marking_consumers_destroy(state.consumers);
+    state.hda->labels = pn->labels;
+    cell_index_destroy(state.visited);
+    free(state.scratch);
+    marking_arena_destroy(state.arena);
+    return state.hda;
 }
@@ -1,50 +1,27 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
 #include <stdlib.h>
-#include "hashtbl.h"
+#include <string.h>
 #include "hda.h"
+#include "logger.h"
 
-__attribute__((unused)) static inline void __free_labels_cell(void* l, __attribute__((unused))void* unused) {
-    if (l && *(char**)l) free(*(char**)l);
-}
-
-void free_cell(struct cell* c) {
-    if (!c) return;
-    if (c->d0) vector_destroy(c->d0);
-    if (c->d1) vector_destroy(c->d1);
-    if (c->labels) {
-        // not sure if copy or not for now...
-        // vector_forall(c->labels, __free_labels_cell, NULL);
-        vector_destroy(c->labels);
-    }
-    free(c);
-}
-
-struct cell* init_cell(size_t dim) {
-    struct cell* c = calloc(1, sizeof(*c));
-    if (!c) return NULL;
-    c->dim = dim;
-    if (dim) {
-        c->d0 = vector_new(sizeof(struct cell*), dim);
-        c->d1 = vector_new(sizeof(struct cell*), dim);
-        c->labels = vector_new(sizeof(char*), dim);
-    } else {
-        // d0 represent the incomming edges of our vertex and d1 the outgoing
-        // up to 2 of each
-        c->d0 = vector_new(sizeof(struct cell*), 2);
-        c->d1 = vector_new(sizeof(struct cell*), 2);
+size_t cell_labels_signature(const uint32_t* labels, size_t nb_labels) {
+    // sum of the hashes of the ids: the signature does not depend on the order
+    size_t signature = nb_labels;
+    for (size_t i = 0; i < nb_labels; i++) {
+        unsigned long long x = labels[i] + 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        signature += (size_t)(x ^ (x >> 31));
     }
-    return c;
-}
-
-static inline void __free_cells_hda(void* c, __attribute__((unused))void* unused) {
-    if (c) free_cell(*((struct cell**)c));
+    return signature;
 }
 
 void free_hda(struct hda* hda, bool free_content) {
     if (!hda) return;
+    hda_free_cofaces(hda);
     if (hda->cells && free_content)
-        vector_forall(hda->cells, __free_cells_hda, NULL);
-    if (hda->cells)
-        vector_destroy(hda->cells);
+        cell_arena_destroy(hda->cells);
     if (hda->final)
         vector_destroy(hda->final);
     if (hda->initial)
@@ -55,78 +32,240 @@ void free_hda(struct hda* hda, bool free_content) {
 struct hda* init_hda(void) {
     struct hda* hda = malloc(sizeof(*hda));
     if (!hda) return NULL;
-    hda->cells = vector_new(sizeof(struct cell*), 0);
-    hda->initial = vector_new(sizeof(struct cell*), 0);
-    hda->final = vector_new(sizeof(struct cell*), 0);
+    hda->cells = cell_arena_new();
+    hda->initial = vector_new(sizeof(cell_id), 0);
+    hda->final = vector_new(sizeof(cell_id), 0);
+    hda->labels = NULL;
+    hda->status = CONVERSION_COMPLETE;
+    hda->nb_unexplored = 0;
+    hda->cofaces = NULL;
     if (!hda->cells || !hda->initial || !hda->final) {
-        free_hda(hda, false);
+        free_hda(hda, true);
         return NULL;
     }
     return hda;
 }
 
-static size_t _cmp_cell_ptr(const void* c1, const void* c2) {
-    return c1 != c2;
+Vector(cell_id) hda_output_order(struct hda* hda) {
+    size_t nb_cells = cell_arena_length(hda->cells);
+    // counting sort on the dimension
+    struct vector* counts = vector_new(sizeof(size_t), 0);
+    struct vector* order = vector_new(sizeof(cell_id), nb_cells);
+    if (!counts || !order) {
+        if (counts) vector_destroy(counts);
+        if (order) vector_destroy(order);
+        return NULL;
+    }
+    for (size_t i = 0; i < nb_cells; i++) {
+        size_t d = cell_arena_get(hda->cells, (cell_id) i)->dim;
+        while (vector_length(counts) <= d + 1) {
+            if (!vector_push(counts, &(size_t){ 0 })) {
+                vector_destroy(counts);
+                vector_destroy(order);
+                return NULL;
+            }
+        }
+        ((size_t*)vector_to_array(counts))[d + 1]++;
+        vector_push(order, &(cell_id){ 0 });
+    }
+    size_t* first = vector_to_array(counts);
+    for (size_t d = 1; d < vector_length(counts); d++)
+        first[d] += first[d - 1];
+    cell_id* ids = vector_to_array(order);
+    for (size_t i = 0; i < nb_cells; i++)
+        ids[first[cell_arena_get(hda->cells, (cell_id) i)->dim]++] = (cell_id) i;
+    vector_destroy(counts);
+    return order;
 }
 
-static size_t _hash_cell_ptr(const void* key) {
-    return (size_t)key << 1;
+bool cell_formatter_init(struct cell_formatter* f, struct vector* labels, const size_t* numbers) {
+    size_t nb_labels = labels ? vector_length(labels) : 0;
+    f->names = nb_labels ? vector_to_array(labels) : NULL;
+    f->numbers = numbers;
+    f->cofaces = NULL;
+    f->name_lengths = malloc((nb_labels + 1) * sizeof(size_t));
+    if (!f->name_lengths) return false;
+    for (size_t i = 0; i < nb_labels; i++)
+        f->name_lengths[i] = strlen(f->names[i]);
+    return true;
 }
 
-static struct hashtbl* init_printer(struct hda* hda) {
-    struct hashtbl* out;
-    HASHTBL_NEW(out, void*, size_t, .hash_func = _hash_cell_ptr, .cmp_func = _cmp_cell_ptr,);
-    if (!out) return NULL;
-    struct cell** cells = vector_to_array(hda->cells);
-    size_t dim = 0, idx = 0;
-    while (idx < vector_length(hda->cells)) {
-        for (size_t i = 0; i < vector_length(hda->cells); i++) {
-            if (cells[i]->dim == dim) {
-                hashtbl_add(out, cells[i], (void*)idx, true);
-                idx++;
+void cell_formatter_destroy(struct cell_formatter* f) {
+    free(f->name_lengths);
+}
+
+// longest decimal size_t
+#define NUMBER_SIZE 20
+
+size_t cell_formatter_bound(const struct cell_formatter* f, struct cell* c) {
+    size_t size = 2 * NUMBER_SIZE + sizeof(": dim=:\t[]; d0: []; d1: []");
+    uint32_t* labels = cell_list_array(&c->labels);
+    for (size_t k = 0; k < c->labels.length; k++)
+        size += f->name_lengths[labels[k]] + 2;
+    if (f->cofaces)
+        size += sizeof("; up0: []; up1: []") + (hda_up0_length(f->cofaces, c->id) + hda_up1_length(f->cofaces, c->id)) * (NUMBER_SIZE + 2);
+    return size + (c->d0.length + c->d1.length) * (NUMBER_SIZE + 2);
+}
+
+static inline char* _put_string(char* p, const char* s, size_t length) {
+    memcpy(p, s, length);
+    return p + length;
+}
+
+#define PUT_LITERAL(p, s) _put_string(p, s, sizeof(s) - 1)
+
+static inline char* _put_number(char* p, size_t n) {
+    char digits[NUMBER_SIZE];
+    size_t i = NUMBER_SIZE;
+    do {
+        digits[--i] = (char)('0' + n % 10);
+        n /= 10;
+    } while (n);
+    return _put_string(p, digits + i, NUMBER_SIZE - i);
+}
+
+static inline char* _put_faces(char* p, const struct cell_formatter* f, const cell_id* ids, size_t length) {
+    for (size_t k = 0; k < length; k++) {
+        if (k) p = PUT_LITERAL(p, ", ");
+        p = _put_number(p, f->numbers ? f->numbers[ids[k]] : ids[k]);
+    }
+    return p;
+}
+
+static inline char* _put_cofaces(char* p, const struct cell_formatter* f, struct cell* c) {
+    if (!f->cofaces)
+        return p;
+    p = PUT_LITERAL(p, "; up0: [");
+    p = _put_faces(p, f, hda_up0(f->cofaces, c->id), hda_up0_length(f->cofaces, c->id));
+    p = PUT_LITERAL(p, "]; up1: [");
+    p = _put_faces(p, f, hda_up1(f->cofaces, c->id), hda_up1_length(f->cofaces, c->id));
+    return PUT_LITERAL(p, "]");
+}
+
+size_t cell_formatter_write(const struct cell_formatter* f, char* buf, struct cell* c, size_t number) {
+    char* p = _put_number(buf, number);
+    p = PUT_LITERAL(p, ": dim=");
+    p = _put_number(p, c->dim);
+    if (!c->dim)
+        return (size_t)(_put_cofaces(p, f, c) - buf);
+    p = PUT_LITERAL(p, ":\t[");
+    uint32_t* labels = cell_list_array(&c->labels);
+    for (size_t k = 0; k < c->labels.length; k++) {
+        if (k) p = PUT_LITERAL(p, ", ");
+        p = _put_string(p, f->names[labels[k]], f->name_lengths[labels[k]]);
+    }
+    p = PUT_LITERAL(p, "]; d0: [");
+    p = _put_faces(p, f, cell_list_array(&c->d0), c->d0.length);
+    p = PUT_LITERAL(p, "]; d1: [");
+    p = _put_faces(p, f, cell_list_array(&c->d1), c->d1.length);
+    p = PUT_LITERAL(p, "]");
+    return (size_t)(_put_cofaces(p, f, c) - buf);
+}
+
+// number of cells formatted by a thread in one go
+#define PRINT_CHUNK (1ul << 14)
+
+// text of the cells order[first..last) (growing buffer)
+struct _chunk {
+    struct hda* hda;
+    const struct cell_formatter* formatter;
+    const cell_id* order;
+    size_t first;
+    size_t last;
+    char* text;
+    size_t length;
+    size_t capacity;
+    bool ok;
+    bool threaded; // formatted by its own thread
+    pthread_t thread;
+};
+
+static void* _format_chunk(void* arg) {
+    struct _chunk* chunk = arg;
+    chunk->length = 0;
+    for (size_t i = chunk->first; i < chunk->last; i++) {
+        struct cell* c = cell_arena_get(chunk->hda->cells, chunk->order[i]);
+        size_t size = cell_formatter_bound(chunk->formatter, c) + 2;
+        if (chunk->length + size > chunk->capacity) {
+            size_t capacity = 2 * (chunk->length + size);
+            char* text = realloc(chunk->text, capacity);
+            if (!text) {
+                chunk->ok = false;
+                return NULL;
             }
+            chunk->text = text;
+            chunk->capacity = capacity;
+        }
+        if (i) {
+            memcpy(chunk->text + chunk->length, ",\n", 2);
+            chunk->length += 2;
         }
-        dim++;
+        chunk->length += cell_formatter_write(chunk->formatter, chunk->text + chunk->length, c, i);
     }
-    return out;
+    return NULL;
 }
 
-void print_hda(struct hda* hda, FILE* out) {
-    struct hashtbl* nb = init_printer(hda);
-    if (!nb) return;
-    struct cell** cells = vector_to_array(hda->cells);
-    fprintf(out, "cells:\n");
-    size_t dim = 0, idx = 0;
-    while (idx < vector_length(hda->cells)) {
-        for (size_t i = 0; i < vector_length(hda->cells); i++) {
-            if (cells[i]->dim != dim) continue;
-            if (i) fprintf(out, ",\n");
-            fprintf(out, "%zu: dim=%zu", idx, dim);
-            idx++;
-            if (dim) {
-                fprintf(out, ":\t[");
-                char** labels = vector_to_array(cells[i]->labels);
-                for (size_t k = 0; k < vector_length(cells[i]->labels); k++) {
-                    if (k) fprintf(out, ", ");
-                    fprintf(out, "%s", labels[k]);
-                }
-                fprintf(out, "]; d0: [");
-                struct cell** d0 = vector_to_array(cells[i]->d0);
-                for (size_t k = 0; k < vector_length(cells[i]->d0); k++) {
-                    if (k) fprintf(out, ", ");
-                    fprintf(out, "%zu", (size_t)hashtbl_find(nb, (void*)d0[k]).value);
-                }
-                fprintf(out, "]; d1: [");
-                struct cell** d1 = vector_to_array(cells[i]->d1);
-                for (size_t k = 0; k < vector_length(cells[i]->d1); k++) {
-                    if (k) fprintf(out, ", ");
-                    fprintf(out, "%zu", (size_t)hashtbl_find(nb, (void*)d1[k]).value);
-                }
-                fprintf(out, "]");
-            }
+// the calling thread formats the first chunk of each round (and the ones whose thread cannot be started)
+static bool _print_cells(struct hda* hda, FILE* out, const cell_id* order, const struct cell_formatter* formatter,
+                         struct _chunk* chunks, size_t nb_threads) {
+    size_t nb_cells = cell_arena_length(hda->cells);
+    // each round the threads format consecutive chunks, written in order by the calling thread
+    for (size_t first = 0; first < nb_cells; first += nb_threads * PRINT_CHUNK) {
+        for (size_t t = 0; t < nb_threads; t++) {
+            size_t begin = first + t * PRINT_CHUNK;
+            chunks[t].hda = hda;
+            chunks[t].formatter = formatter;
+            chunks[t].order = order;
+            chunks[t].first = begin < nb_cells ? begin : nb_cells;
+            chunks[t].last = begin + PRINT_CHUNK < nb_cells ? begin + PRINT_CHUNK : nb_cells;
+            chunks[t].ok = true;
+            chunks[t].threaded = t && chunks[t].first < chunks[t].last
+                && !pthread_create(&chunks[t].thread, NULL, _format_chunk, &chunks[t]);
+        }
+        for (size_t t = 0; t < nb_threads; t++) {
+            if (chunks[t].threaded)
+                pthread_join(chunks[t].thread, NULL);
+            else
+                _format_chunk(&chunks[t]);
         }
-        dim++;
+        for (size_t t = 0; t < nb_threads; t++) {
+            if (!chunks[t].ok)
+                return false;
+            // the chunks past the last cell are empty (and have no text)
+            if (chunks[t].length)
+                fwrite(chunks[t].text, 1, chunks[t].length, out);
+        }
+    }
+    return true;
+}
+
+void print_hda_parallel(struct hda* hda, FILE* out, size_t nb_threads) {
+    if (!nb_threads) nb_threads = 1;
+    struct vector* order = hda_output_order(hda);
+    size_t nb_cells = cell_arena_length(hda->cells);
+    size_t* numbers = malloc((nb_cells + 1) * sizeof(size_t));
+    struct _chunk* chunks = calloc(nb_threads, sizeof(*chunks));
+    struct cell_formatter formatter = { 0 };
+    bool ok = order && numbers && chunks && cell_formatter_init(&formatter, hda->labels, numbers);
+    if (ok) {
+        cell_id* ids = vector_to_array(order);
+        for (size_t i = 0; i < nb_cells; i++)
+            numbers[ids[i]] = i;
+        formatter.cofaces = hda->cofaces;
+        fputs("cells:\n", out);
+        ok = _print_cells(hda, out, ids, &formatter, chunks, nb_threads);
+        fputs("\n", out);
     }
-    fprintf(out, "\n");
-    hashtbl_destroy(nb);
+    if (!ok)
+        LOG(ERROR, "%s", "Unable to print the HDA: not enough memory");
+    for (size_t t = 0; chunks && t < nb_threads; t++)
+        free(chunks[t].text);
+    cell_formatter_destroy(&formatter);
+    if (order) vector_destroy(order);
+    free(chunks);
+    free(numbers);
+}
+
+void print_hda(struct hda* hda, FILE* out) {
+    print_hda_parallel(hda, out, 1);
 }
@@ -0,0 +1,210 @@
+#include "hda_binary.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define OUT_BUFFER_SIZE (1ul << 16)
+
+static inline uint64_t _align(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t) 7;
+}
+
+// buffered sequential writer keeping track of the position in the file
+struct _output {
+    FILE* f;
+    uint64_t position;
+    size_t length;
+    bool ok;
+    unsigned char buffer[OUT_BUFFER_SIZE];
+};
+
+static void _flush(struct _output* o) {
+    if (o->ok && o->length && fwrite(o->buffer, 1, o->length, o->f) != o->length)
+        o->ok = false;
+    o->length = 0;
+}
+
+static void _write(struct _output* o, const void* data, size_t size) {
+    const unsigned char* bytes = data;
+    while (size) {
+        if (o->length == OUT_BUFFER_SIZE)
+            _flush(o);
+        size_t n = OUT_BUFFER_SIZE - o->length;
+        if (n > size) n = size;
+        memcpy(o->buffer + o->length, bytes, n);
+        o->length += n;
+        o->position += n;
+        bytes += n;
+        size -= n;
+    }
+}
+
+// pad with zeros up to the beginning of the section at offset
+static void _seek(struct _output* o, uint64_t offset) {
+    static const unsigned char zeros[8] = { 0 };
+    _write(o, zeros, offset - o->position);
+}
+
+static void _write_index(struct _output* o, uint32_t width, size_t index) {
+    if (width == 4)
+        _write(o, &(uint32_t){ (uint32_t) index }, sizeof(uint32_t));
+    else
+        _write(o, &(uint64_t){ index }, sizeof(uint64_t));
+}
+
+enum _list { LIST_D0, LIST_D1, LIST_LABELS, LIST_UP0, LIST_UP1 };
+
+// ids of the list of the cell id and their number
+static const uint32_t* _list(struct hda* hda, cell_id id, enum _list list, size_t* length) {
+    struct cell* c = cell_arena_get(hda->cells, id);
+    switch (list) {
+        case LIST_D0:
+            *length = c->d0.length;
+            return cell_list_array(&c->d0);
+        case LIST_D1:
+            *length = c->d1.length;
+            return cell_list_array(&c->d1);
+        case LIST_LABELS:
+            *length = c->labels.length;
+            return cell_list_array(&c->labels);
+        case LIST_UP0:
+            *length = hda_up0_length(hda->cofaces, id);
+            return hda_up0(hda->cofaces, id);
+        case LIST_UP1:
+        default:
+            *length = hda_up1_length(hda->cofaces, id);
+            return hda_up1(hda->cofaces, id);
+    }
+}
+
+// offsets of the lists of the cells, in output order
+static void _write_offsets(struct _output* o, struct hda* hda, cell_id* order, size_t nb_cells, enum _list list) {
+    uint64_t offset = 0;
+    _write(o, &offset, sizeof(offset));
+    for (size_t i = 0; i < nb_cells; i++) {
+        size_t length;
+        _list(hda, order[i], list, &length);
+        offset += length;
+        _write(o, &offset, sizeof(offset));
+    }
+}
+
+static void _write_faces(struct _output* o, struct hda* hda, cell_id* order, size_t* numbers, size_t nb_cells, uint32_t width, enum _list list) {
+    for (size_t i = 0; i < nb_cells; i++) {
+        size_t length;
+        const cell_id* ids = _list(hda, order[i], list, &length);
+        for (size_t k = 0; k < length; k++)
+            _write_index(o, width, numbers[ids[k]]);
+    }
+}
+
+bool hda_write_binary(struct hda* hda, FILE* out) {
+    struct vector* order_v = hda_output_order(hda);
+    size_t nb_cells = cell_arena_length(hda->cells);
+    size_t* numbers = malloc((nb_cells + 1) * sizeof(size_t));
+    struct _output* o = malloc(sizeof(*o));
+    if (!order_v || !numbers || !o) {
+        if (order_v) vector_destroy(order_v);
+        free(numbers);
+        free(o);
+        return false;
+    }
+    cell_id* order = vector_to_array(order_v);
+    size_t nb_dims = 0;
+    uint64_t nb_d0 = 0, nb_d1 = 0, nb_labels = 0;
+    for (size_t i = 0; i < nb_cells; i++) {
+        struct cell* c = cell_arena_get(hda->cells, order[i]);
+        numbers[order[i]] = i;
+        nb_dims = c->dim + 1;
+        nb_d0 += c->d0.length;
+        nb_d1 += c->d1.length;
+        nb_labels += c->labels.length;
+    }
+    size_t nb_names = hda->labels ? vector_length(hda->labels) : 0;
+    char** names = nb_names ? vector_to_array(hda->labels) : NULL;
+    uint64_t strings_size = 0;
+    for (size_t l = 0; l < nb_names; l++)
+        strings_size += strlen(names[l]) + 1;
+
+    struct hda_binary_header h = {
+        .version = HDA_BINARY_VERSION,
+        .byte_order = HDA_BINARY_BYTE_ORDER,
+        .index_width = nb_cells <= UINT32_MAX ? 4 : 8,
+        .nb_cells = nb_cells,
+        .nb_dims = nb_dims,
+        .nb_labels = nb_names,
+    };
+    memcpy(h.magic, HDA_BINARY_MAGIC, sizeof(h.magic));
+    h.dims = _align(sizeof(h));
+    h.d0_offsets = _align(h.dims + (nb_dims + 1) * sizeof(uint64_t));
+    h.d0 = _align(h.d0_offsets + (nb_cells + 1) * sizeof(uint64_t));
+    h.d1_offsets = _align(h.d0 + nb_d0 * h.index_width);
+    h.d1 = _align(h.d1_offsets + (nb_cells + 1) * sizeof(uint64_t));
+    h.labels_offsets = _align(h.d1 + nb_d1 * h.index_width);
+    h.labels = _align(h.labels_offsets + (nb_cells + 1) * sizeof(uint64_t));
+    h.label_names = _align(h.labels + nb_labels * sizeof(uint32_t));
+    h.label_strings = _align(h.label_names + nb_names * sizeof(uint64_t));
+    h.file_size = _align(h.label_strings + strings_size);
+    if (hda->cofaces) {
+        size_t nb_up0 = hda->cofaces->up0_offsets[nb_cells], nb_up1 = hda->cofaces->up1_offsets[nb_cells];
+        h.up0_offsets = h.file_size;
+        h.up0 = _align(h.up0_offsets + (nb_cells + 1) * sizeof(uint64_t));
+        h.up1_offsets = _align(h.up0 + nb_up0 * h.index_width);
+        h.up1 = _align(h.up1_offsets + (nb_cells + 1) * sizeof(uint64_t));
+        h.file_size = _align(h.up1 + nb_up1 * h.index_width);
+    }
+
+    o->f = out;
+    o->position = 0;
+    o->length = 0;
+    o->ok = true;
+    _write(o, &h, sizeof(h));
+
+    _seek(o, h.dims);
+    for (size_t d = 0, i = 0; d <= nb_dims; d++) {
+        while (i < nb_cells && cell_arena_get(hda->cells, order[i])->dim < d)
+            i++;
+        _write(o, &(uint64_t){ i }, sizeof(uint64_t));
+    }
+    _seek(o, h.d0_offsets);
+    _write_offsets(o, hda, order, nb_cells, LIST_D0);
+    _seek(o, h.d0);
+    _write_faces(o, hda, order, numbers, nb_cells, h.index_width, LIST_D0);
+    _seek(o, h.d1_offsets);
+    _write_offsets(o, hda, order, nb_cells, LIST_D1);
+    _seek(o, h.d1);
+    _write_faces(o, hda, order, numbers, nb_cells, h.index_width, LIST_D1);
+    _seek(o, h.labels_offsets);
+    _write_offsets(o, hda, order, nb_cells, LIST_LABELS);
+    _seek(o, h.labels);
+    for (size_t i = 0; i < nb_cells; i++) {
+        struct cell* c = cell_arena_get(hda->cells, order[i]);
+        _write(o, cell_list_array(&c->labels), c->labels.length * sizeof(uint32_t));
+    }
+    _seek(o, h.label_names);
+    for (size_t l = 0, offset = 0; l < nb_names; l++) {
+        _write(o, &(uint64_t){ offset }, sizeof(uint64_t));
+        offset += strlen(names[l]) + 1;
+    }
+    _seek(o, h.label_strings);
+    for (size_t l = 0; l < nb_names; l++)
+        _write(o, names[l], strlen(names[l]) + 1);
+    if (hda->cofaces) {
+        _seek(o, h.up0_offsets);
+        _write_offsets(o, hda, order, nb_cells, LIST_UP0);
+        _seek(o, h.up0);
+        _write_faces(o, hda, order, numbers, nb_cells, h.index_width, LIST_UP0);
+        _seek(o, h.up1_offsets);
+        _write_offsets(o, hda, order, nb_cells, LIST_UP1);
+        _seek(o, h.up1);
+        _write_faces(o, hda, order, numbers, nb_cells, h.index_width, LIST_UP1);
+    }
+    _seek(o, h.file_size);
+    _flush(o);
+
+    bool ok = o->ok && !fflush(out);
+    vector_destroy(order_v);
+    free(numbers);
+    free(o);
+    return ok;
+}
@@ -0,0 +1,110 @@
+#define _POSIX_C_SOURCE 200809L
+#include "hda_binary.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+// the section [offset, offset + size) is in the file
+static inline bool _in_file(size_t file_size, uint64_t offset, uint64_t size) {
+    return !(offset & 7) && offset <= file_size && size <= file_size - offset;
+}
+
+// header and bounds of the arrays of fixed size
+static bool _check_header(const struct hda_binary_header* h, size_t size) {
+    if (size < sizeof(*h) || memcmp(h->magic, HDA_BINARY_MAGIC, sizeof(h->magic)) || h->version != HDA_BINARY_VERSION
+        || h->byte_order != HDA_BINARY_BYTE_ORDER || (h->index_width != 4 && h->index_width != 8) || h->file_size != size)
+        return false;
+    // the sizes of the arrays are bounded by the size of the file: the products below cannot overflow
+    if (h->nb_cells > size || h->nb_dims > size || h->nb_labels > size)
+        return false;
+    return _in_file(size, h->dims, (h->nb_dims + 1) * sizeof(uint64_t))
+        && _in_file(size, h->d0_offsets, (h->nb_cells + 1) * sizeof(uint64_t))
+        && _in_file(size, h->d1_offsets, (h->nb_cells + 1) * sizeof(uint64_t))
+        && _in_file(size, h->labels_offsets, (h->nb_cells + 1) * sizeof(uint64_t))
+        && _in_file(size, h->label_names, h->nb_labels * sizeof(uint64_t))
+        && _in_file(size, h->label_strings, 0)
+        && (!h->up0_offsets || (_in_file(size, h->up0_offsets, (h->nb_cells + 1) * sizeof(uint64_t))
+                                && _in_file(size, h->up1_offsets, (h->nb_cells + 1) * sizeof(uint64_t))));
+}
+
+// bounds of the lists (their content is not checked: indexes of a corrupted file may be out of range)
+static bool _check_lists(const struct hda_binary* b) {
+    const struct hda_binary_header* h = b->header;
+    uint64_t nb_d0 = b->d0_offsets[h->nb_cells], nb_d1 = b->d1_offsets[h->nb_cells], nb_labels = b->labels_offsets[h->nb_cells];
+    if (nb_d0 > b->size || nb_d1 > b->size || nb_labels > b->size || b->dims[h->nb_dims] != h->nb_cells)
+        return false;
+    if (!_in_file(b->size, h->d0, nb_d0 * h->index_width)
+        || !_in_file(b->size, h->d1, nb_d1 * h->index_width)
+        || !_in_file(b->size, h->labels, nb_labels * sizeof(uint32_t)))
+        return false;
+    if (!b->up0_offsets)
+        return true;
+    uint64_t nb_up0 = b->up0_offsets[h->nb_cells], nb_up1 = b->up1_offsets[h->nb_cells];
+    return nb_up0 <= b->size && nb_up1 <= b->size
+        && _in_file(b->size, h->up0, nb_up0 * h->index_width)
+        && _in_file(b->size, h->up1, nb_up1 * h->index_width);
+}
+
+struct hda_binary* hda_binary_open(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LOG(ERROR, "Cannot open binary HDA `%s'", path);
+        return NULL;
+    }
+    struct stat st;
+    struct hda_binary* b = calloc(1, sizeof(*b));
+    if (!b || fstat(fd, &st) || !st.st_size) {
+        LOG(ERROR, "Cannot read binary HDA `%s'", path);
+        free(b);
+        close(fd);
+        return NULL;
+    }
+    b->size = (size_t) st.st_size;
+    b->map = mmap(NULL, b->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (b->map == MAP_FAILED) {
+        LOG(ERROR, "Cannot map binary HDA `%s'", path);
+        free(b);
+        return NULL;
+    }
+    const unsigned char* base = b->map;
+    const struct hda_binary_header* h = b->header = b->map;
+    if (!_check_header(h, b->size)) {
+        LOG(ERROR, "`%s' is not a binary HDA (version %d)", path, HDA_BINARY_VERSION);
+        hda_binary_close(b);
+        return NULL;
+    }
+    b->dims = (const uint64_t*)(base + h->dims);
+    b->d0_offsets = (const uint64_t*)(base + h->d0_offsets);
+    b->d0 = base + h->d0;
+    b->d1_offsets = (const uint64_t*)(base + h->d1_offsets);
+    b->d1 = base + h->d1;
+    b->labels_offsets = (const uint64_t*)(base + h->labels_offsets);
+    b->labels = (const uint32_t*)(base + h->labels);
+    b->label_names = (const uint64_t*)(base + h->label_names);
+    b->label_strings = (const char*)(base + h->label_strings);
+    if (h->up0_offsets) {
+        b->up0_offsets = (const uint64_t*)(base + h->up0_offsets);
+        b->up0 = base + h->up0;
+        b->up1_offsets = (const uint64_t*)(base + h->up1_offsets);
+        b->up1 = base + h->up1;
+    }
+    if (!_check_lists(b)) {
+        LOG(ERROR, "Binary HDA `%s' is truncated", path);
+        hda_binary_close(b);
+        return NULL;
+    }
+    return b;
+}
+
+void hda_binary_close(struct hda_binary* b) {
+    if (!b) return;
+    munmap(b->map, b->size);
+    free(b);
+}
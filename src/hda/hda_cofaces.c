@@ -0,0 +1,153 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "hda.h"
+
+// cells handled by a thread in one go
+#define COFACES_CHUNK (1ul << 12)
+// longer lists are sorted with qsort
+#define INSERTION_SORT_MAX 32
+
+enum _phase {
+    PHASE_COUNT, // length of the lists
+    PHASE_FILL, // the offsets are the ends of the lists: a cell is put just before the end of its list
+    PHASE_SORT,
+};
+
+struct _job {
+    struct hda* hda;
+    struct hda_cofaces* up;
+    enum _phase phase;
+    size_t* next; // first cell of the next chunk, shared by the threads of the phase
+    bool threaded;
+    pthread_t thread;
+};
+
+static void _count(struct cell_list* l, size_t* offsets) {
+    cell_id* ids = cell_list_array(l);
+    for (size_t k = 0; k < l->length; k++)
+        __atomic_fetch_add(&offsets[ids[k]], 1, __ATOMIC_RELAXED);
+}
+
+static void _fill(struct cell_list* l, size_t* offsets, cell_id* up, cell_id id) {
+    cell_id* ids = cell_list_array(l);
+    for (size_t k = 0; k < l->length; k++)
+        up[__atomic_sub_fetch(&offsets[ids[k]], 1, __ATOMIC_RELAXED)] = id;
+}
+
+static int _cmp_ids(const void* a, const void* b) {
+    cell_id x = *(const cell_id*) a, y = *(const cell_id*) b;
+    return (x > y) - (x < y);
+}
+
+static void _sort(cell_id* ids, size_t length) {
+    if (length > INSERTION_SORT_MAX) {
+        qsort(ids, length, sizeof(*ids), _cmp_ids);
+        return;
+    }
+    for (size_t i = 1; i < length; i++) {
+        cell_id id = ids[i];
+        size_t j = i;
+        for (; j && ids[j - 1] > id; j--)
+            ids[j] = ids[j - 1];
+        ids[j] = id;
+    }
+}
+
+static void* _work(void* arg) {
+    struct _job* job = arg;
+    struct hda_cofaces* up = job->up;
+    size_t first;
+    while ((first = __atomic_fetch_add(job->next, COFACES_CHUNK, __ATOMIC_RELAXED)) < up->nb_cells) {
+        size_t last = first + COFACES_CHUNK < up->nb_cells ? first + COFACES_CHUNK : up->nb_cells;
+        for (size_t i = first; i < last; i++) {
+            if (job->phase == PHASE_SORT) {
+                _sort(up->up0 + up->up0_offsets[i], up->up0_offsets[i + 1] - up->up0_offsets[i]);
+                _sort(up->up1 + up->up1_offsets[i], up->up1_offsets[i + 1] - up->up1_offsets[i]);
+                continue;
+            }
+            struct cell* c = cell_arena_get(job->hda->cells, (cell_id) i);
+            // d0 and d1 of a vertex are its cofaces
+            if (!c->dim)
+                continue;
+            if (job->phase == PHASE_COUNT) {
+                _count(&c->d0, up->up0_offsets);
+                _count(&c->d1, up->up1_offsets);
+            } else {
+                _fill(&c->d0, up->up0_offsets, up->up0, c->id);
+                _fill(&c->d1, up->up1_offsets, up->up1, c->id);
+            }
+        }
+    }
+    return NULL;
+}
+
+// the calling thread works as well (alone if no thread can be started)
+static void _run(struct _job* jobs, size_t nb_threads, enum _phase phase) {
+    size_t next = 0;
+    for (size_t t = 0; t < nb_threads; t++) {
+        jobs[t].phase = phase;
+        jobs[t].next = &next;
+        jobs[t].threaded = t && !pthread_create(&jobs[t].thread, NULL, _work, &jobs[t]);
+    }
+    _work(&jobs[0]);
+    for (size_t t = 1; t < nb_threads; t++) {
+        if (jobs[t].threaded)
+            pthread_join(jobs[t].thread, NULL);
+    }
+}
+
+// offsets[c] = end of the list of c (the sum of the lengths up to c), offsets[n] = total length
+static size_t _ends(size_t* offsets, size_t n) {
+    size_t sum = 0;
+    for (size_t i = 0; i < n; i++)
+        offsets[i] = sum += offsets[i];
+    return offsets[n] = sum;
+}
+
+static void _free(struct hda_cofaces* up) {
+    if (!up) return;
+    free(up->up0_offsets);
+    free(up->up0);
+    free(up->up1_offsets);
+    free(up->up1);
+    free(up);
+}
+
+bool hda_build_cofaces(struct hda* hda, size_t nb_threads) {
+    if (!nb_threads) nb_threads = 1;
+    hda_free_cofaces(hda);
+    size_t nb_cells = cell_arena_length(hda->cells);
+    struct hda_cofaces* up = calloc(1, sizeof(*up));
+    struct _job* jobs = calloc(nb_threads, sizeof(*jobs));
+    if (!up || !jobs || !(up->up0_offsets = calloc(nb_cells + 1, sizeof(size_t)))
+        || !(up->up1_offsets = calloc(nb_cells + 1, sizeof(size_t)))) {
+        _free(up);
+        free(jobs);
+        return false;
+    }
+    up->nb_cells = nb_cells;
+    for (size_t t = 0; t < nb_threads; t++)
+        jobs[t] = (struct _job){ .hda = hda, .up = up };
+
+    _run(jobs, nb_threads, PHASE_COUNT);
+    size_t nb_up0 = _ends(up->up0_offsets, nb_cells), nb_up1 = _ends(up->up1_offsets, nb_cells);
+    if (!(up->up0 = malloc((nb_up0 ? nb_up0 : 1) * sizeof(cell_id))) || !(up->up1 = malloc((nb_up1 ? nb_up1 : 1) * sizeof(cell_id)))) {
+        _free(up);
+        free(jobs);
+        return false;
+    }
+    // the offsets are back at the beginning of the lists once they are filled
+    _run(jobs, nb_threads, PHASE_FILL);
+    // the order of the fill depends on the threads
+    _run(jobs, nb_threads, PHASE_SORT);
+    free(jobs);
+    hda->cofaces = up;
+    return true;
+}
+
+void hda_free_cofaces(struct hda* hda) {
+    _free(hda->cofaces);
+    hda->cofaces = NULL;
+}
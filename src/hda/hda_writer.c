@@ -0,0 +1,146 @@
+#define _POSIX_C_SOURCE 200809L
+#include "hda_writer.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logger.h"
+
+// the writer is woken up once WRITER_BATCH cells are waiting and formats them in one go
+#define WRITER_BATCH 256
+#define WRITER_BUFFER_SIZE (1ul << 20)
+
+struct hda_writer {
+    FILE* out;
+    struct cell_formatter formatter; // cells are numbered by their id
+    char* text; // formatted cells not written yet
+    size_t text_length;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t batch_ready;
+    pthread_cond_t not_full;
+    struct cell** queue; // ring buffer
+    size_t capacity;
+    size_t head;
+    size_t length;
+    bool finished; // no more cells will be pushed
+    size_t written;
+};
+
+static void _format(struct hda_writer* w, struct cell* c) {
+    size_t size = cell_formatter_bound(&w->formatter, c) + 2;
+    if (w->text_length + size > WRITER_BUFFER_SIZE) {
+        fwrite(w->text, 1, w->text_length, w->out);
+        w->text_length = 0;
+    }
+    if (size > WRITER_BUFFER_SIZE) {
+        // cell larger than the buffer
+        char* text = malloc(size);
+        if (!text) {
+            LOG(ERROR, "Unable to write the cell %zu: not enough memory", (size_t) c->id);
+            return;
+        }
+        if (w->written++) fputs(",\n", w->out);
+        fwrite(text, 1, cell_formatter_write(&w->formatter, text, c, c->id), w->out);
+        free(text);
+        return;
+    }
+    if (w->written++) {
+        memcpy(w->text + w->text_length, ",\n", 2);
+        w->text_length += 2;
+    }
+    w->text_length += cell_formatter_write(&w->formatter, w->text + w->text_length, c, c->id);
+}
+
+static void* _writer_loop(void* arg) {
+    struct hda_writer* w = arg;
+    struct cell* batch[WRITER_BATCH];
+    fprintf(w->out, "cells:\n");
+    while (true) {
+        pthread_mutex_lock(&w->lock);
+        while (w->length < WRITER_BATCH && !w->finished)
+            pthread_cond_wait(&w->batch_ready, &w->lock);
+        if (!w->length) {
+            pthread_mutex_unlock(&w->lock);
+            break;
+        }
+        bool was_full = w->length == w->capacity;
+        size_t n = 0;
+        for (; n < WRITER_BATCH && w->length; n++, w->length--) {
+            batch[n] = w->queue[w->head];
+            w->head = (w->head + 1) % w->capacity;
+        }
+        // several exploration threads may be waiting
+        if (was_full)
+            pthread_cond_broadcast(&w->not_full);
+        pthread_mutex_unlock(&w->lock);
+
+        // the cells are read only: their boundaries are final
+        for (size_t i = 0; i < n; i++)
+            _format(w, batch[i]);
+    }
+    fwrite(w->text, 1, w->text_length, w->out);
+    fputs("\n", w->out);
+    fflush(w->out);
+    return NULL;
+}
+
+struct hda_writer* hda_writer_start(FILE* out, struct vector* labels, size_t capacity) {
+    struct hda_writer* w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    w->out = out;
+    w->capacity = capacity > WRITER_BATCH ? capacity : WRITER_BATCH;
+    w->queue = malloc(w->capacity * sizeof(*(w->queue)));
+    w->text = malloc(WRITER_BUFFER_SIZE);
+    if (!w->queue || !w->text || !cell_formatter_init(&w->formatter, labels, NULL)) {
+        free(w->queue);
+        free(w->text);
+        free(w);
+        return NULL;
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->batch_ready, NULL);
+    pthread_cond_init(&w->not_full, NULL);
+    if (pthread_create(&w->thread, NULL, _writer_loop, w)) {
+        LOG(ERROR, "%s", "Unable to start the writer thread");
+        pthread_cond_destroy(&w->not_full);
+        pthread_cond_destroy(&w->batch_ready);
+        pthread_mutex_destroy(&w->lock);
+        cell_formatter_destroy(&w->formatter);
+        free(w->queue);
+        free(w->text);
+        free(w);
+        return NULL;
+    }
+    return w;
+}
+
+void hda_writer_push(struct hda_writer* w, struct cell* c) {
+    pthread_mutex_lock(&w->lock);
+    while (w->length == w->capacity)
+        pthread_cond_wait(&w->not_full, &w->lock);
+    w->queue[(w->head + w->length) % w->capacity] = c;
+    if (++(w->length) == WRITER_BATCH)
+        pthread_cond_signal(&w->batch_ready);
+    pthread_mutex_unlock(&w->lock);
+}
+
+size_t hda_writer_finish(struct hda_writer* w) {
+    pthread_mutex_lock(&w->lock);
+    w->finished = true;
+    pthread_cond_signal(&w->batch_ready);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+
+    size_t written = w->written;
+    pthread_cond_destroy(&w->not_full);
+    pthread_cond_destroy(&w->batch_ready);
+    pthread_mutex_destroy(&w->lock);
+    cell_formatter_destroy(&w->formatter);
+    free(w->queue);
+    free(w->text);
+    free(w);
+    return written;
+}
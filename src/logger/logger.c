@@ -1,9 +1,16 @@
 #ifdef __linux__
     #define _GNU_SOURCE
+#else
+    #define _POSIX_C_SOURCE 200809L
 #endif // __linux__
 #include "logger.h"
 
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -15,6 +22,12 @@
 #define WHITE "\033[0m"
 #define ORANGE "\033[0;38:2:220:165:0m"
 
+// records of the ring of a thread (a power of 2): a thread logging faster than they are written waits
+#define RING_SIZE 128
+// the writer wakes up (and reads the clock) at least every WRITER_PERIOD_NS
+#define WRITER_PERIOD_NS 50000000l
+#define OUTFILE_BUFFER_SIZE (1 << 16)
+
 static const char* log_level_str[] = {
 #define X(A) [A] = #A,
     LOG_LVL(X)
@@ -29,47 +42,113 @@ static struct logger_options logger_options = {
 #endif // __linux__
 };
 
+struct _record {
+    uint64_t seq; // order of the call among all the threads
+    time_t time;
+    enum log_level level;
+    const char* file_name;
+    size_t line;
+    const char* func_name;
+    char message[LOGGER_MESSAGE_SIZE];
+};
+
+// Single producer (its thread), single consumer (the thread holding drain_lock) ring of records:
+// the records head - tail .. head - 1 are pending.
+struct _ring {
+    struct _record records[RING_SIZE];
+    uint64_t head; // written by the producer
+    uint64_t tail; // written by the consumer
+    bool orphaned; // its thread exited: released once empty
+#ifdef __linux__
+    pid_t tid;
+#endif // __linux__
+    struct _ring* next;
+};
+
+static __thread struct _ring* local_ring = NULL;
+static pthread_key_t ring_key;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+// protects the list of rings, the consumer side of the rings and the outputs
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct _ring* rings = NULL;
+
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t writer;
+static bool writer_running = false; // read without the lock by the logging threads
+static bool writer_stopping = false;
+
+enum log_level logger_min_level = INFO;
+
+static uint64_t seq = 0; // next sequence number
+static uint64_t next_written = 0; // sequence number of the next record to write (under drain_lock)
+static time_t cached_time = 0; // written by the writer only, read by every logging thread
+
+// only ERROR and FATAL are written when the logs are neither displayed nor stored
+static void _update_min_level(void) {
+    logger_min_level = logger_options.min_level;
+    if (!outfile && !logger_options.output_logs && logger_min_level < ERROR)
+        logger_min_level = ERROR;
+}
+
 void logger_set_options(struct logger_options options) {
     logger_options = options;
+    _update_min_level();
+}
+
+bool logger_level_from_name(const char* name, enum log_level* level) {
+    for (size_t i = 0; i < sizeof(log_level_str) / sizeof(*log_level_str); i++) {
+        if (!strcmp(name, log_level_str[i])) {
+            *level = (enum log_level) i;
+            return true;
+        }
+    }
+    return false;
 }
 
 bool logger_set_outfile(const char* filename) {
-    if (outfile != NULL) return false;
-    FILE* f = fopen(filename, "w");
-    if (!f) return false;
-    outfile = f;
-    return true;
+    pthread_mutex_lock(&drain_lock);
+    bool ok = !outfile && (outfile = fopen(filename, "w"));
+    if (ok) {
+        setvbuf(outfile, NULL, _IOFBF, OUTFILE_BUFFER_SIZE);
+        _update_min_level();
+    }
+    pthread_mutex_unlock(&drain_lock);
+    return ok;
 }
 
-void logger_close_outfile(void) {
-    if (outfile) {
-        fclose(outfile);
-        outfile = NULL;
+// date of the records, formatted once per second
+static const char* _date(time_t t) {
+    static time_t date_time = (time_t) -1;
+    static char date[100];
+    if (t != date_time) {
+        struct tm tt;
+        localtime_r(&t, &tt);
+        snprintf(date, sizeof(date), "[%d-%d-%d %d:%d:%d]", tt.tm_year + 1900, tt.tm_mon + 1, tt.tm_mday, tt.tm_hour, tt.tm_min, tt.tm_sec);
+        date_time = t;
     }
+    return date;
 }
 
-void logger_log(enum log_level level, const char* file_name, size_t line, const char* func_name, char* message) {
-#ifdef __linux__
-    pid_t id = gettid();
-#endif // __linux__
-    time_t t = time(NULL);
-    struct tm* tt = localtime(&t); 
-    char date[100] = { 0 };
-    sprintf(date, "[%d-%d-%d %d:%d:%d]", tt->tm_year + 1900, tt->tm_mon + 1, tt->tm_mday, tt->tm_hour, tt->tm_min, tt->tm_sec);
+static void _write(struct _ring* ring, struct _record* r) {
+    const char* date = _date(r->time);
     if (outfile) {
-        fprintf(outfile, "[%s] %s ", log_level_str[level], date);
+        fprintf(outfile, "[%s] %s ", log_level_str[r->level], date);
 #ifdef __linux__
-        if (id == getpid())
+        if (ring->tid == getpid())
             fprintf(outfile, "[main thread] ");
         else
-            fprintf(outfile, "[thread: %d] ", id);
+            fprintf(outfile, "[thread: %d] ", ring->tid);
+#else
+        (void) ring;
 #endif // __linux__
-        fprintf(outfile, "%s:%zu in %s(): %s\n", file_name, line, func_name, message);
+        fprintf(outfile, "%s:%zu in %s(): %s\n", r->file_name, r->line, r->func_name, r->message);
     }
-    if (logger_options.output_logs || level == FATAL || level == ERROR) {
+    if (logger_options.output_logs || r->level == FATAL || r->level == ERROR) {
         const char* color;
         FILE* out;
-        switch (level) {
+        switch (r->level) {
             case INFO:
                 color = TURQUOISE;
                 out = stdout;
@@ -87,22 +166,178 @@ void logger_log(enum log_level level, const char* file_name, size_t line, const
                 out = stderr;
                 break;
             case FATAL:
+            default:
                 color = RED;
                 out = stderr;
                 break;
         }
-        fprintf(out, "%s[%s]%s ", color, log_level_str[level], WHITE);
+        fprintf(out, "%s[%s]%s ", color, log_level_str[r->level], WHITE);
         if (logger_options.show_date)
             fprintf(out, "%s ", date);
 #ifdef __linux__
         if (logger_options.show_thread_id)
         {
-            if (id == getpid())
+            if (ring->tid == getpid())
                 fprintf(out, "[main thread] ");
             else
-                fprintf(out, "[thread: %d] ", id);
+                fprintf(out, "[thread: %d] ", ring->tid);
+        }
+#endif // __linux__
+        fprintf(out, "%s:%zu in %s(): %s%s%s\n", r->file_name, r->line, r->func_name, color, r->message, WHITE);
+    }
+}
+
+// Write the pending records in the order of their sequence numbers and release the rings of the
+// exited threads. The records are written up to the first sequence number taken by a thread which
+// has not published its record yet; if wait, up to every sequence number taken before the call (a
+// thread publishes its record right after taking its number, without blocking).
+static void _drain(bool wait) {
+    pthread_mutex_lock(&drain_lock);
+    uint64_t last = wait ? __atomic_load_n(&seq, __ATOMIC_SEQ_CST) : 0;
+    while (true) {
+        struct _ring* first = NULL;
+        for (struct _ring* ring = rings; ring; ring = ring->next) {
+            uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+            if (ring->tail != head && (!first || ring->records[ring->tail % RING_SIZE].seq < first->records[first->tail % RING_SIZE].seq))
+                first = ring;
+        }
+        if (!first || first->records[first->tail % RING_SIZE].seq != next_written) {
+            if (next_written >= last)
+                break;
+            sched_yield();
+            continue;
+        }
+        _write(first, &first->records[first->tail % RING_SIZE]);
+        __atomic_store_n(&first->tail, first->tail + 1, __ATOMIC_RELEASE);
+        next_written++;
+    }
+    for (struct _ring** ring = &rings; *ring; ) {
+        struct _ring* r = *ring;
+        if (__atomic_load_n(&r->orphaned, __ATOMIC_ACQUIRE) && r->tail == __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) {
+            *ring = r->next;
+            free(r);
+        } else {
+            ring = &r->next;
+        }
+    }
+    if (outfile)
+        fflush(outfile);
+    fflush(stdout);
+    fflush(stderr);
+    pthread_mutex_unlock(&drain_lock);
+}
+
+static void* _writer_loop(__attribute__((unused))void* args) {
+    pthread_mutex_lock(&writer_lock);
+    while (!writer_stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        __atomic_store_n(&cached_time, deadline.tv_sec, __ATOMIC_RELAXED);
+        deadline.tv_nsec += WRITER_PERIOD_NS;
+        if (deadline.tv_nsec >= 1000000000l) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000l;
         }
+        pthread_cond_timedwait(&writer_cond, &writer_lock, &deadline);
+        pthread_mutex_unlock(&writer_lock);
+        _drain(false);
+        pthread_mutex_lock(&writer_lock);
+    }
+    pthread_mutex_unlock(&writer_lock);
+    return NULL;
+}
+
+static void _wake_writer(void) {
+    pthread_mutex_lock(&writer_lock);
+    pthread_cond_signal(&writer_cond);
+    pthread_mutex_unlock(&writer_lock);
+}
+
+// the records are written before the process exits (exit after a FATAL log, or end of main)
+static void _stop_writer(void) {
+    pthread_mutex_lock(&writer_lock);
+    bool running = writer_running;
+    writer_stopping = true;
+    // the records logged from now on are written by their threads
+    __atomic_store_n(&writer_running, false, __ATOMIC_SEQ_CST);
+    pthread_cond_signal(&writer_cond);
+    pthread_mutex_unlock(&writer_lock);
+    if (running && !pthread_equal(pthread_self(), writer))
+        pthread_join(writer, NULL);
+    _drain(true);
+}
+
+static void _orphan(void* ring) {
+    __atomic_store_n(&((struct _ring*) ring)->orphaned, true, __ATOMIC_RELEASE);
+}
+
+static void _init(void) {
+    cached_time = time(NULL);
+    pthread_key_create(&ring_key, _orphan);
+    atexit(_stop_writer);
+    // without a writer thread the records are written by the threads which log them
+    writer_running = !pthread_create(&writer, NULL, _writer_loop, NULL);
+}
+
+static struct _ring* _register(void) {
+    pthread_once(&once, _init);
+    struct _ring* ring = calloc(1, sizeof(*ring));
+    if (!ring)
+        return NULL;
+#ifdef __linux__
+    ring->tid = gettid();
 #endif // __linux__
-        fprintf(out, "%s:%zu in %s(): %s%s%s\n", file_name, line, func_name, color, message, WHITE);
+    pthread_setspecific(ring_key, ring);
+    pthread_mutex_lock(&drain_lock);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&drain_lock);
+    return local_ring = ring;
+}
+
+void logger_log(enum log_level level, const char* file_name, size_t line, const char* func_name, const char* fmt, ...) {
+    // nothing would be written
+    if (!outfile && !logger_options.output_logs && level != FATAL && level != ERROR)
+        return;
+    struct _ring* ring = local_ring ? local_ring : _register();
+    if (!ring)
+        return;
+    // full ring: wait for the writer
+    bool running = __atomic_load_n(&writer_running, __ATOMIC_SEQ_CST);
+    while (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == RING_SIZE) {
+        if (running)
+            _wake_writer();
+        else
+            _drain(true);
+        sched_yield();
+    }
+    struct _record* r = &ring->records[ring->head % RING_SIZE];
+    r->seq = __atomic_fetch_add(&seq, 1, __ATOMIC_RELAXED);
+    r->time = running ? __atomic_load_n(&cached_time, __ATOMIC_RELAXED) : time(NULL);
+    r->level = level;
+    r->file_name = file_name;
+    r->line = line;
+    r->func_name = func_name;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(r->message, sizeof(r->message), fmt, args);
+    va_end(args);
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+    if (!running || level == FATAL || level == ERROR)
+        _drain(true);
+}
+
+void logger_flush(void) {
+    _drain(true);
+}
+
+void logger_close_outfile(void) {
+    _drain(true);
+    pthread_mutex_lock(&drain_lock);
+    if (outfile) {
+        fclose(outfile);
+        outfile = NULL;
+        _update_min_level();
     }
+    pthread_mutex_unlock(&drain_lock);
 }
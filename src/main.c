@@ -1,19 +1,110 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "logger.h"
 #include "petri_nets.h"
 #include "command_line.h"
 #include "hda.h"
+#include "hda_writer.h"
+#include "hda_binary.h"
+#include "batch.h"
+#include "stats.h"
 
 static void __xmlGenericErrorFunc (__attribute__((unused))void *ctx, __attribute__((unused))const char *msg, ...) { }
 
 static void internal_help(const char* program) {
         char buff[1000] = { 0 };
-        snprintf(buff, 1000, "Usage: %s [OPTIONS] FILE\n\twith FILE the pnml file to load (mandatory)\n", program);
+        snprintf(buff, 1000, "Usage: %s [OPTIONS] FILE...\n\twith FILE the pnml file to load (mandatory unless --batch is given)\n"
+                             "\twith several FILEs (or --batch), every net of every file is converted in its own output file\n", program);
         display_help(buff);
 }
 
+// size in bytes with an optional K, M or G suffix (0 if invalid)
+static size_t parse_size(const char* str) {
+    char* rest = NULL;
+    double size = strtod(str, &rest);
+    if (rest == str || size <= 0)
+        return 0;
+    switch (*rest) {
+        case 'G': case 'g': size *= 1024;
+        // fallthrough
+        case 'M': case 'm': size *= 1024;
+        // fallthrough
+        case 'K': case 'k': size *= 1024;
+            rest++;
+            break;
+        default:
+            break;
+    }
+    if (*rest && strcmp(rest, "B") && strcmp(rest, "b"))
+        return 0;
+    return (size_t) size;
+}
+
+static void free_file(void* file, __attribute__((unused))void* unused) {
+    free(*(char**) file);
+}
+
+static void release_resources(void) {
+#ifndef NOSTATS
+    const char* stats = get_argument_value("stats");
+    if (stats && !stats_write(stats))
+        LOG(ERROR, "Unable to write the statistics in `%s'", stats);
+    stats_release();
+#endif // NOSTATS
+    free_argument_parser();
+#ifndef NOLOG
+    logger_close_outfile();
+#endif // NOLOG
+}
+
+// batch mode: the files of the command line and of the --batch list
+static int run_batch(struct conversion_options conversion_options) {
+    Vector(char*) files = vector_new(sizeof(char*), 0);
+    const char* list = get_argument_value("batch");
+    Vector(char*) listed = list ? batch_read_list(list) : NULL;
+    if (list && !listed)
+        LOG(ERROR, "Unable to read the list of files `%s'", list);
+    for (size_t i = 0; files && i < get_nb_positional_arguments(); i++)
+        vector_push(files, &(char*){ strdup(get_positional_argument(i)) });
+    for (size_t i = 0; files && listed && i < vector_length(listed); i++)
+        vector_push(files, (char**) vector_to_array(listed) + i);
+    if (!files || (list && !listed)) {
+        if (listed) vector_destroy(listed);
+        if (files) vector_destroy(files);
+        release_resources();
+        return -1;
+    }
+    if (listed) vector_destroy(listed);
+
+    const char* format = get_argument_value("format");
+    struct batch_options options = {
+        .nb_threads = conversion_options.nb_threads,
+        .output_dir = get_argument_value("output-dir"),
+        .binary = !strcmp(format, "binary"),
+        .cofaces = is_flag_set("cofaces"),
+        .conversion = conversion_options,
+    };
+    if (!options.binary && strcmp(format, "text"))
+        LOG(WARNING, "Unknown output format `%s': using text", format);
+    if (is_flag_set("print-pn") || is_flag_set("print-hda") || is_flag_set("stream") || options.conversion.checkpoint || options.conversion.resume)
+        LOG(WARNING, "%s", "--print-pn, --print-hda, --stream, --checkpoint and --resume are ignored in batch mode");
+    options.conversion.checkpoint = options.conversion.resume = NULL;
+
+    // libxml2 must be initialized before the files are parsed by several threads
+    xmlInitParser();
+    size_t nb_failures = batch_convert((const char* const*) vector_to_array(files), vector_length(files), options);
+    LOG(nb_failures ? ERROR : INFO, "%zu files processed, %zu failures", vector_length(files), nb_failures);
+
+    vector_forall(files, free_file, NULL);
+    vector_destroy(files);
+    release_resources();
+    return nb_failures ? -1 : 0;
+}
+
 int main(int argc, char** argv) {
     xmlSetGenericErrorFunc(NULL, __xmlGenericErrorFunc);
     xmlThrDefSetGenericErrorFunc(NULL, __xmlGenericErrorFunc);
@@ -21,17 +112,33 @@ int main(int argc, char** argv) {
     add_argument("help", 'h', "display help message", true, (arg_default_value){ .is_set = false });
 #ifndef NOLOG
     add_argument("logs", 0, "whether to display logs on stdout: YES|NO (default: YES)", false, (arg_default_value){ .value = "YES" });
-    add_argument("log_date", 0, "whether to display date in stdout logs: YES|NO (default: NO)", false, (arg_default_value){ .value = "NO" });
+    add_argument("log-date", 0, "whether to display date in stdout logs: YES|NO (default: NO)", false, (arg_default_value){ .value = "NO" });
 #ifdef __linux__
-    add_argument("log_threads", 0, "whether to display the thread id in the stdout logs: YES|NO (default: NO)", false, (arg_default_value){ .value = "NO" });
+    add_argument("log-threads", 0, "whether to display the thread id in the stdout logs: YES|NO (default: NO)", false, (arg_default_value){ .value = "NO" });
 #endif // __linux__
-    add_argument("log_file", 'f', "to specify a file to store logs (can be in addition of stdout logs)", false, (arg_default_value){ .value = NULL });
+    add_argument("log-level", 0, "level under which the logs are not written: INFO|WARNING|ERROR|TIMEOUT|FATAL (default: INFO)", false, (arg_default_value){ .value = "INFO" });
+    add_argument("log-file", 'f', "to specify a file to store logs (can be in addition of stdout logs)", false, (arg_default_value){ .value = NULL });
 #endif // NOLOG
-    add_argument("print_pn", 0, "use the petri net pretty print", true, (arg_default_value){ .is_set = false });
-    add_argument("print_hda", 0, "print the output HDA in stdout", true, (arg_default_value){ .is_set = false });
+#ifndef NOSTATS
+    add_argument("stats", 0, "JSON file in which the counters of the conversion and the time of each phase are written", false, (arg_default_value){ .value = NULL });
+#endif // NOSTATS
+    add_argument("print-pn", 0, "use the petri net pretty print", true, (arg_default_value){ .is_set = false });
+    add_argument("print-hda", 0, "print the output HDA in stdout", true, (arg_default_value){ .is_set = false });
     add_argument("output", 'o', "output file to store the HDA", false, (arg_default_value){ .value = "out.hda" });
+    add_argument("format", 'O', "format of the output file: text|binary (default: text)", false, (arg_default_value){ .value = "text" });
+    add_argument("cofaces", 0, "write the cofaces of each cell (up0: the cells having it in d0, up1: in d1) after its faces", true, (arg_default_value){ .is_set = false });
+    add_argument("stream", 0, "write the cells in the output file during the exploration (cells are numbered in creation order)", true, (arg_default_value){ .is_set = false });
+    add_argument("threads", 'j', "number of threads (nets converted at the same time in batch mode, output, cofaces: the exploration is sequential), 0 for all the cores (default: 1)", false, (arg_default_value){ .value = "1" });
+    add_argument("max-dim", 0, "only build the cells of dimension <= k, k >= 1 (the k-skeleton of the HDA, default: no bound)", false, (arg_default_value){ .value = NULL });
+    add_argument("time-limit", 0, "time budget of a conversion in seconds: the partial HDA is written once it is reached (default: none)", false, (arg_default_value){ .value = NULL });
+    add_argument("memory-limit", 0, "budget of the resident memory gained since the conversion started, in bytes or with a K|M|G suffix: the partial HDA is written once it is reached (default: none)", false, (arg_default_value){ .value = NULL });
+    add_argument("checkpoint", 0, "file in which a snapshot of the exploration is periodically written (sequential exploration only)", false, (arg_default_value){ .value = NULL });
+    add_argument("checkpoint-interval", 0, "seconds between two snapshots of --checkpoint (default: 300)", false, (arg_default_value){ .value = "300" });
+    add_argument("resume", 0, "snapshot written by --checkpoint from which the exploration of the same net is resumed", false, (arg_default_value){ .value = NULL });
+    add_argument("batch", 0, "file listing the pnml files to convert (one per line): every net of every file is converted, -j nets at the same time", false, (arg_default_value){ .value = NULL });
+    add_argument("output-dir", 0, "directory of the output files in batch mode (default: next to each input)", false, (arg_default_value){ .value = NULL });
 
-    if (argc == 1 || !parse_command_line(argc-1, argv) || is_flag_set("help") || !strcmp(argv[argc-1], "-h") || !strcmp(argv[argc-1], "--help")) {
+    if (argc == 1 || !parse_command_line(argc, argv) || is_flag_set("help") || (!get_nb_positional_arguments() && !get_argument_value("batch"))) {
         internal_help(argv[0]);
         return -1;
     }
@@ -39,62 +146,136 @@ int main(int argc, char** argv) {
 #ifndef NOLOG
     struct logger_options l = (struct logger_options) {
         .output_logs = strcmp(get_argument_value("logs"), "YES") == 0,
-        .show_date = strcmp(get_argument_value("log_date"), "YES") == 0,
+        .show_date = strcmp(get_argument_value("log-date"), "YES") == 0,
 #ifdef __linux__
-        .show_thread_id = strcmp(get_argument_value("log_threads"), "YES") == 0,
+        .show_thread_id = strcmp(get_argument_value("log-threads"), "YES") == 0,
 #endif // __linux__
     };
+    const char* log_level = get_argument_value("log-level");
+    bool known_level = logger_level_from_name(log_level, &l.min_level);
     logger_set_options(l);
-    const char* file_log = get_argument_value("log_file");
+    if (!known_level)
+        LOG(WARNING, "Unknown log level `%s': using INFO", log_level);
+    const char* file_log = get_argument_value("log-file");
     if (file_log) {
         if (!logger_set_outfile(file_log))
             LOG(ERROR, "Unable to open log file `%s': skipping error", file_log);
     }
 #endif // NOLOG
 
-    xmlDocPtr document = xmlParseFile(argv[argc-1]);
-    if (!document) {
-        LOG(ERROR, "Cannot parse xml file `%s'", argv[argc-1]);
-        return -1;
+    struct conversion_options options = { .nb_threads = 1 };
+    char* rest = NULL;
+    long nb_threads = strtol(get_argument_value("threads"), &rest, 10);
+    if (nb_threads < 0 || (rest && *rest)) {
+        LOG(WARNING, "Invalid number of threads `%s': using 1 thread", get_argument_value("threads"));
+    } else if (!nb_threads) {
+        long nb_cores = sysconf(_SC_NPROCESSORS_ONLN);
+        options.nb_threads = nb_cores > 0 ? (size_t) nb_cores : 1;
+    } else {
+        options.nb_threads = (size_t) nb_threads;
+    }
+    const char* max_dim = get_argument_value("max-dim");
+    if (max_dim) {
+        long k = strtol(max_dim, &rest, 10);
+        if (k < 1 || (rest && *rest))
+            LOG(WARNING, "Invalid maximal dimension `%s' (the vertices are reached through the 1-cells: at least 1): the dimension is not bounded", max_dim);
+        else
+            options.dim_bound = (size_t) k + 1;
+    }
+    const char* time_limit = get_argument_value("time-limit");
+    if (time_limit) {
+        double seconds = strtod(time_limit, &rest);
+        if (seconds <= 0 || rest == time_limit || (rest && *rest))
+            LOG(WARNING, "Invalid time limit `%s': the time is not bounded", time_limit);
+        else
+            options.time_limit = seconds;
+    }
+    options.checkpoint = get_argument_value("checkpoint");
+    options.resume = get_argument_value("resume");
+    const char* interval = get_argument_value("checkpoint-interval");
+    options.checkpoint_interval = strtod(interval, &rest);
+    if (options.checkpoint_interval < 1 || rest == interval || (rest && *rest)) {
+        LOG(WARNING, "Invalid checkpoint interval `%s': using 300s", interval);
+        options.checkpoint_interval = 300;
     }
+    const char* memory_limit = get_argument_value("memory-limit");
+    if (memory_limit && !(options.memory_limit = parse_size(memory_limit)))
+        LOG(WARNING, "Invalid memory limit `%s': the memory is not bounded", memory_limit);
 
-    struct petri_net* net = parse_xml_file(xmlDocGetRootElement(document));
-    xmlFreeDoc(document);
+    if (get_nb_positional_arguments() > 1 || get_argument_value("batch"))
+        return run_batch(options);
 
+    const char* file = get_positional_argument(0);
+    STATS_PHASE_START(STATS_PARSE);
+    struct petri_net* net = parse_pnml_file(file);
+    STATS_PHASE_END(STATS_PARSE);
     if (!net) {
-        LOG(ERROR, "Unable to get P/T net from file `%s'", argv[argc-1]);
+        LOG(ERROR, "Unable to get P/T net from file `%s'", file);
+        release_resources();
         return -1;
     }
 
-    if (is_flag_set("print_pn"))
+    if (is_flag_set("print-pn"))
         pn_pretty_print(net);
 
-    struct hda* hda = conversion(net);
+    const char* outFile = get_argument_value("output");
+    bool binary = !strcmp(get_argument_value("format"), "binary");
+    if (!binary && strcmp(get_argument_value("format"), "text"))
+        LOG(WARNING, "Unknown output format `%s': using text", get_argument_value("format"));
+    if (binary && is_flag_set("stream"))
+        LOG(WARNING, "%s", "The binary output cannot be streamed: it is written at the end of the conversion");
+    if (is_flag_set("cofaces") && !binary && is_flag_set("stream"))
+        LOG(WARNING, "%s", "The cofaces are not known while the cells are streamed: they are not written");
+    FILE* stream = NULL;
+    if (outFile && !binary && is_flag_set("stream")) {
+        stream = fopen(outFile, "w");
+        if (stream && !(options.writer = hda_writer_start(stream, net->labels, 1ul << 16)))
+            LOG(ERROR, "%s", "Unable to stream the HDA: it is written at the end of the conversion");
+    }
+
+    STATS_PHASE_START(STATS_CONVERT);
+    struct hda* hda = conversion(net, options);
+    STATS_PHASE_END(STATS_CONVERT);
     LOG(INFO, "%s", "Conversion algorithm finished");
+    bool partial = hda->status != CONVERSION_COMPLETE;
+
+    if (options.writer) {
+        __attribute__((unused)) size_t written = hda_writer_finish(options.writer);
+        LOG(INFO, "%zu cells streamed to `%s'", written, outFile);
+    }
 
-    if (is_flag_set("print_hda"))
-        print_hda(hda, stdout);
+    STATS_PHASE_START(STATS_PRINT);
+    if (is_flag_set("cofaces") && !options.writer && !hda_build_cofaces(hda, options.nb_threads))
+        LOG(ERROR, "%s", "Unable to build the cofaces: not enough memory");
+    if (is_flag_set("print-hda"))
+        print_hda_parallel(hda, stdout, options.nb_threads);
 
-    const char* outFile = get_argument_value("output");
-    if (outFile) {
-        FILE* out = fopen(outFile, "w");
+    if (outFile && !options.writer) {
+        FILE* out = stream ? stream : fopen(outFile, binary ? "wb" : "w");
         if (!out) {
             LOG(ERROR, "Cannot open output file `%s'", outFile);
+        } else if (binary) {
+            if (!hda_write_binary(hda, out))
+                LOG(ERROR, "Unable to write the binary HDA in `%s'", outFile);
+            fclose(out);
         } else {
-            print_hda(hda, out);
+            print_hda_parallel(hda, out, options.nb_threads);
             fclose(out);
         }
+    } else if (stream) {
+        fclose(stream);
     }
+    STATS_PHASE_END(STATS_PRINT);
+
+    if (partial)
+        LOG(TIMEOUT, "Partial HDA: %zu cells, %zu of them in the unexplored frontier", cell_arena_length(hda->cells), hda->nb_unexplored);
 
     petri_net_destroy(net);
     free_hda(hda, true);
     LOG(INFO, "%s", "End of the program");
 
+    release_resources();
 
-    free_argument_parser();
-#ifndef NOLOG
-    logger_close_outfile();
-#endif // NOLOG
-
-    return 0;
+    // the output is usable but incomplete
+    return partial ? 2 : 0;
 }
@@ -0,0 +1,349 @@
+#include "marking.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+#define MIN_BLOCK_SIZE (1ul << 16)
+
+struct marking_arena {
+    Vector(unsigned char*) blocks;
+    unsigned char* current; // next free byte of the last block
+    size_t left; // number of free bytes in the last block
+    size_t allocated;
+    size_t marking_size;
+    uint32_t nb_places;
+    uint32_t width;
+};
+
+uint32_t marking_width_for_net(struct petri_net* pn) {
+    // if no transition produces more tokens than it consumes the number of tokens of
+    // any place is bounded by the number of tokens in the initial marking
+    struct pn_transition** transitions = vector_to_array(pn->transitions);
+    for (size_t i = 0; i < vector_length(pn->transitions); i++) {
+        if (vector_length(transitions[i]->postset) > vector_length(transitions[i]->preset))
+            return 4;
+    }
+    size_t total = 0;
+    size_t* initial = vector_to_array(pn->marking);
+    for (size_t i = 0; i < vector_length(pn->marking); i++)
+        total += initial[i];
+    if (total <= UINT8_MAX)
+        return 1;
+    if (total <= UINT16_MAX)
+        return 2;
+    return 4;
+}
+
+size_t marking_size(uint32_t nb_places, uint32_t width) {
+    size_t size = sizeof(struct marking) + (size_t) nb_places * width;
+    // keep the headers of consecutive markings aligned
+    return (size + sizeof(size_t) - 1) & ~(sizeof(size_t) - 1);
+}
+
+struct marking_arena* marking_arena_new(uint32_t nb_places, uint32_t width) {
+    struct marking_arena* arena = calloc(1, sizeof(*arena));
+    if (!arena) return NULL;
+    arena->blocks = vector_new(sizeof(unsigned char*), 0);
+    if (!arena->blocks) {
+        free(arena);
+        return NULL;
+    }
+    arena->nb_places = nb_places;
+    arena->width = width;
+    arena->marking_size = marking_size(nb_places, width);
+    return arena;
+}
+
+static void _free_block(void* block, __attribute__((unused))void* unused) {
+    free(*(unsigned char**)block);
+}
+
+void marking_arena_destroy(struct marking_arena* arena) {
+    if (!arena) return;
+    vector_forall(arena->blocks, _free_block, NULL);
+    vector_destroy(arena->blocks);
+    free(arena);
+}
+
+size_t marking_arena_size(struct marking_arena* arena) {
+    return arena->allocated;
+}
+
+struct marking* marking_scratch_new(struct marking_arena* arena) {
+    struct marking* m = calloc(1, arena->marking_size);
+    if (!m) return NULL;
+    m->nb_places = arena->nb_places;
+    m->width = arena->width;
+    return m;
+}
+
+struct marking* marking_arena_commit(struct marking_arena* arena, const struct marking* m) {
+    STATS_INC(markings_committed);
+    if (arena->left < arena->marking_size) {
+        size_t block_size = 64 * arena->marking_size;
+        if (block_size < MIN_BLOCK_SIZE)
+            block_size = MIN_BLOCK_SIZE;
+        unsigned char* block = malloc(block_size);
+        if (!block) return NULL;
+        if (!vector_push(arena->blocks, &block)) {
+            free(block);
+            return NULL;
+        }
+        arena->current = block;
+        arena->left = block_size;
+        arena->allocated += block_size;
+    }
+    struct marking* out = (struct marking*) arena->current;
+    memcpy(out, m, arena->marking_size);
+    arena->current += arena->marking_size;
+    arena->left -= arena->marking_size;
+    return out;
+}
+
+// hash of one counter: the marking hash is the sum over all places so it is updated
+// in O(1) when a counter changes
+static inline size_t _mix(size_t place, size_t value) {
+    // splitmix64 finalizer
+    unsigned long long x = (((unsigned long long) place << 32) ^ value) + 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return (size_t)(x ^ (x >> 31));
+}
+
+static inline void _set(struct marking* m, size_t place, size_t value) {
+    m->hash += _mix(place, value) - _mix(place, marking_get(m, place));
+    switch (m->width) {
+        case 1:
+            m->counters[place] = (uint8_t) value;
+            break;
+        case 2: {
+            uint16_t v = (uint16_t) value;
+            memcpy(m->counters + 2 * place, &v, sizeof(v));
+            break;
+        }
+        default: {
+            uint32_t v = (uint32_t) value;
+            memcpy(m->counters + 4 * place, &v, sizeof(v));
+            break;
+        }
+    }
+}
+
+static inline size_t _max_value(const struct marking* m) {
+    return m->width == 1 ? UINT8_MAX : m->width == 2 ? UINT16_MAX : UINT32_MAX;
+}
+
+bool marking_from_vector(struct marking* out, struct vector* v) {
+    size_t* values = vector_to_array(v);
+    if (vector_length(v) != out->nb_places)
+        return false;
+    memset(out->counters, 0, (size_t) out->nb_places * out->width);
+    out->hash = 0;
+    for (size_t i = 0; i < out->nb_places; i++)
+        out->hash += _mix(i, 0);
+    for (size_t i = 0; i < out->nb_places; i++) {
+        if (values[i] > _max_value(out))
+            return false;
+        _set(out, i, values[i]);
+    }
+    return true;
+}
+
+void marking_rehash(struct marking* m) {
+    m->hash = 0;
+    for (size_t i = 0; i < m->nb_places; i++)
+        m->hash += _mix(i, marking_get(m, i));
+}
+
+size_t marking_transition_is_activable(struct pn_transition* t, const struct marking* m) {
+    size_t* preset = vector_to_array(t->preset);
+    size_t len = vector_length(t->preset);
+    // a transition without input place could be started infinitely many times: it is ignored
+    size_t count = len ? ~0ul : 0;
+    for (size_t i = 0; i < len; i++) {
+        if (preset[i] >= m->nb_places)
+            return 0;
+        // an arc may appear several times in the preset: its weight is its number of occurrences
+        size_t weight = 0;
+        for (size_t k = 0; k < len; k++)
+            weight += preset[k] == preset[i];
+        size_t n = marking_get(m, preset[i]) / weight;
+        if (n < count)
+            count = n;
+    }
+    return count;
+}
+
+bool marking_start_transition(struct pn_transition* t, const struct marking* m, struct marking* out) {
+    STATS_INC(transitions_started);
+    if (out != m)
+        memcpy(out, m, marking_size(m->nb_places, m->width));
+    size_t* preset = vector_to_array(t->preset);
+    for (size_t i = 0; i < vector_length(t->preset); i++) {
+        size_t k = preset[i];
+        if (k >= out->nb_places)
+            return false;
+        size_t v = marking_get(out, k);
+        if (!v)
+            return false;
+        _set(out, k, v - 1);
+    }
+    return true;
+}
+
+bool marking_end_transition(struct pn_transition* t, const struct marking* m, struct marking* out) {
+    STATS_INC(transitions_ended);
+    if (out != m)
+        memcpy(out, m, marking_size(m->nb_places, m->width));
+    size_t* postset = vector_to_array(t->postset);
+    for (size_t i = 0; i < vector_length(t->postset); i++) {
+        size_t k = postset[i];
+        if (k >= out->nb_places)
+            return false;
+        size_t v = marking_get(out, k);
+        if (v >= _max_value(out))
+            return false;
+        _set(out, k, v + 1);
+    }
+    return true;
+}
+
+size_t marking_hash(const void* m) {
+    return ((const struct marking*) m)->hash;
+}
+
+size_t marking_cmp(const void* m1, const void* m2) {
+    const struct marking* a = m1;
+    const struct marking* b = m2;
+    if (a->hash != b->hash || a->nb_places != b->nb_places || a->width != b->width)
+        return 1;
+    return memcmp(a->counters, b->counters, (size_t) a->nb_places * a->width) != 0;
+}
+
+struct marking_consumers {
+    struct vector* pn; // transitions of the net
+    size_t nb_places;
+    size_t* first; // transitions consuming from place p are transitions[first[p]..first[p+1]]
+    size_t* transitions;
+};
+
+// an arc may appear several times in a preset: the transition is listed once for the place
+static inline bool _first_occurrence(size_t* preset, size_t i) {
+    for (size_t k = 0; k < i; k++) {
+        if (preset[k] == preset[i])
+            return false;
+    }
+    return true;
+}
+
+struct marking_consumers* marking_consumers_new(struct petri_net* pn) {
+    struct marking_consumers* index = calloc(1, sizeof(*index));
+    if (!index) return NULL;
+    index->pn = pn->transitions;
+    index->nb_places = vector_length(pn->marking);
+    index->first = calloc(index->nb_places + 1, sizeof(size_t));
+    size_t* next = calloc(index->nb_places + 1, sizeof(size_t));
+    if (!index->first || !next) {
+        free(next);
+        marking_consumers_destroy(index);
+        return NULL;
+    }
+    struct pn_transition** transitions = vector_to_array(pn->transitions);
+    size_t nb_transitions = vector_length(pn->transitions);
+    // count the consumers of each place
+    for (size_t t = 0; t < nb_transitions; t++) {
+        size_t* preset = vector_to_array(transitions[t]->preset);
+        for (size_t i = 0; i < vector_length(transitions[t]->preset); i++) {
+            if (preset[i] < index->nb_places && _first_occurrence(preset, i))
+                index->first[preset[i] + 1]++;
+        }
+    }
+    for (size_t p = 0; p < index->nb_places; p++)
+        index->first[p + 1] += index->first[p];
+    // then fill them (in increasing transition order)
+    index->transitions = malloc((index->first[index->nb_places] + 1) * sizeof(size_t));
+    if (!index->transitions) {
+        free(next);
+        marking_consumers_destroy(index);
+        return NULL;
+    }
+    memcpy(next, index->first, (index->nb_places + 1) * sizeof(size_t));
+    for (size_t t = 0; t < nb_transitions; t++) {
+        size_t* preset = vector_to_array(transitions[t]->preset);
+        for (size_t i = 0; i < vector_length(transitions[t]->preset); i++) {
+            if (preset[i] < index->nb_places && _first_occurrence(preset, i))
+                index->transitions[next[preset[i]]++] = t;
+        }
+    }
+    free(next);
+    return index;
+}
+
+void marking_consumers_destroy(struct marking_consumers* index) {
+    if (!index) return;
+    free(index->first);
+    free(index->transitions);
+    free(index);
+}
+
+static inline bool _push_enabled(struct enabled_list* out, struct pn_transition** transitions, size_t t, const struct marking* m) {
+    size_t count = marking_transition_is_activable(transitions[t], m);
+    return !count || enabled_list_push(out, (struct marking_enabled){ t, count });
+}
+
+bool marking_enabled_all(struct marking_consumers* index, const struct marking* m, struct enabled_list* out) {
+    struct pn_transition** transitions = vector_to_array(index->pn);
+    enabled_list_clear(out);
+    for (size_t t = 0; t < vector_length(index->pn); t++) {
+        if (!_push_enabled(out, transitions, t, m))
+            return false;
+    }
+    return true;
+}
+
+static int _cmp_size(const void* a, const void* b) {
+    size_t x = *(const size_t*) a, y = *(const size_t*) b;
+    return (x > y) - (x < y);
+}
+
+bool marking_enabled_update(struct marking_consumers* index, const struct marking_enabled* parent, size_t nb_parent,
+                            struct vector* places, const struct marking* m, struct index_list* touched, struct enabled_list* out) {
+    struct pn_transition** transitions = vector_to_array(index->pn);
+    size_t* modified = vector_to_array(places);
+    STATS_INC(enabled_updates);
+    index_list_clear(touched);
+    enabled_list_clear(out);
+    for (size_t i = 0; i < vector_length(places); i++) {
+        size_t p = modified[i];
+        if (p < index->nb_places && !index_list_append_n(touched, index->transitions + index->first[p], index->first[p + 1] - index->first[p]))
+            return false;
+    }
+    size_t* ts = index_list_array(touched);
+    size_t nb_touched = index_list_length(touched);
+    qsort(ts, nb_touched, sizeof(size_t), _cmp_size);
+
+    // merge the untouched transitions of the parent with the touched ones evaluated again
+    size_t i = 0, k = 0;
+    while (i < nb_parent || k < nb_touched) {
+        if (k >= nb_touched || (i < nb_parent && parent[i].transition < ts[k])) {
+            // the run of untouched transitions before the next touched one
+            size_t end = i + 1;
+            while (end < nb_parent && (k >= nb_touched || parent[end].transition < ts[k]))
+                end++;
+            if (!enabled_list_append_n(out, parent + i, end - i))
+                return false;
+            i = end;
+            continue;
+        }
+        size_t t = ts[k];
+        if (!_push_enabled(out, transitions, t, m))
+            return false;
+        while (k < nb_touched && ts[k] == t)
+            k++;
+        while (i < nb_parent && parent[i].transition == t)
+            i++;
+    }
+    return true;
+}
@@ -1,6 +1,8 @@
 #include <string.h>
 #include <ctype.h>
 
+#include <libxml/xmlreader.h>
+
 #include "petri_nets.h"
 #include "logger.h"
 #include "hashtbl.h"
@@ -23,65 +25,19 @@ static char* skip_blank(char* str) {
     return str;
 }
 
-static void parse_place(xmlNodePtr curr, struct petri_net* net, Hashtbl(char*, size_t) places) {
-    xmlChar* id = xmlGetProp(curr, (const xmlChar*) "id");
-    if (!id) {
-        LOG(ERROR, "%s", "Invalid transition: expected id attribute");
-        return;
-    }
-    size_t val = 0;
-    for (xmlNodePtr n = curr->children; n; n = n->next) {
-        if (!xmlStrcmp(n->name, (const xmlChar*) "initialMarking")) {
-            xmlNodePtr n2 = n->children;
-            while (n2 && n2->type == XML_TEXT_NODE) n2 = n2->next;
-            if (!n2 || xmlStrcmp(n2->name, (const xmlChar*) "text") || !n2->children) {
-                LOG(WARNING, "Invalid initialMarking in place `%s'", id);
-                continue;
-            }
-            xmlChar* save= xmlNodeListGetString(curr->doc, n2->children, 1);
-            xmlChar* valStr = (xmlChar*) skip_blank((char*) save);
-            char* rest = NULL;
-            long v = 0;
-            if (!valStr || (v = strtol((const char*) valStr, &rest, 10)) < 0 || (rest && *(skip_blank(rest)))) {
-                LOG(WARNING, "Invalid initialMarking in place `%s': got `%s' but expected an unsigned integer", id, valStr);
-                xmlFree(save);
-                continue;
-            }
-            val = v;
-            break;
-        }
-    }
-    size_t p = vector_length(net->marking);
-    vector_push(net->marking, &val);
-    if (!hashtbl_add(places, id, (void*) p, true))
-        LOG(ERROR, "The place `%s' cannot be added in the places hashtable...", id);
+// parse the content of the text of an initialMarking (return false if not an unsigned integer)
+static bool parse_marking_value(char* str, size_t* out) {
+    char* value = skip_blank(str);
+    char* rest = NULL;
+    long v = 0;
+    if (!value || !*value || (v = strtol(value, &rest, 10)) < 0 || (rest && *(skip_blank(rest))))
+        return false;
+    *out = (size_t) v;
+    return true;
 }
 
-static void parse_transition(xmlNodePtr curr, struct petri_net* net, Hashtbl(char*, size_t) transitions) {
-    xmlChar* id = xmlGetProp(curr, (const xmlChar*) "id");
-    if (!id) {
-        LOG(ERROR, "%s", "Invalid transition: expected id attribute");
-        return;
-    }
-    xmlChar* name = NULL;
-    for (xmlNodePtr n = curr->children; n; n = n->next) {
-        if (!xmlStrcmp(n->name, (const xmlChar*) "name")) {
-            xmlNodePtr n2 = n->children;
-            while (n2 && n2->type == XML_TEXT_NODE) n2 = n2->next;
-            if (!n2 || xmlStrcmp(n2->name, (const xmlChar*) "text") || !n2->children) {
-                LOG(WARNING, "Invalid name in transition `%s'", id);
-                continue;
-            }
-            name = xmlNodeListGetString(curr->doc, n2->children, 1);
-            if (!name) {
-                LOG(WARNING, "Invalid name in transition `%s': got null", id);
-                xmlFree(name);
-                name = NULL;
-                continue;
-            }
-            break;
-        }
-    }
+// add the transition id named name (or id if NULL) in the net, name is freed
+static void add_transition(struct petri_net* net, Hashtbl(char*, size_t) transitions, xmlChar* id, xmlChar* name) {
     size_t p = vector_length(net->transitions);
     if (!name)
         name = (xmlChar*) strdup((const char*) id);
@@ -94,22 +50,8 @@ static void parse_transition(xmlNodePtr curr, struct petri_net* net, Hashtbl(cha
     free(saveName);
 }
 
-static void parse_arc(xmlNodePtr curr, struct petri_net* net, Hashtbl(char*, size_t) places, Hashtbl(char*, size_t) transitions) {
-    xmlChar* id = xmlGetProp(curr, (const xmlChar*) "id");
-    xmlChar* source = xmlGetProp(curr, (const xmlChar*) "source");
-    xmlChar* target = xmlGetProp(curr, (const xmlChar*) "target");
-    if (!id || !source || !target) {
-        LOG(ERROR, "%s", "Invalid transition: expected id, source and target attributes");
-        xmlFree(id);
-        xmlFree(source);
-        xmlFree(target);
-        return;
-    }
-    for (xmlNodePtr n = curr->children; n; n = n->next) {
-        if (!xmlStrcmp(n->name, (const xmlChar*) "inscription")) {
-            LOG(WARNING, "Inscription found in arc `%s': inscriptions are ignored...", id);
-        }
-    }
+// add the arc source -> target in the net (return false if source or target is not known)
+static bool add_arc(struct petri_net* net, Hashtbl(char*, size_t) places, Hashtbl(char*, size_t) transitions, xmlChar* source, xmlChar* target) {
     bool isFromPlace = true;
     struct hashtbl_element s = hashtbl_find(places, source);
     if (s.key == NULL && s.value == NULL) {
@@ -121,105 +63,377 @@ static void parse_arc(xmlNodePtr curr, struct petri_net* net, Hashtbl(char*, siz
         t = hashtbl_find(transitions, target);
     else
         t = hashtbl_find(places, target);
-    if ((s.key == NULL && s.value == NULL) || (t.key == NULL && t.value == NULL)) {
-        LOG(ERROR, "Unable to find source or target of arc `%s'", id);
-        xmlFree(id);
-        xmlFree(source);
-        xmlFree(target);
-        return;
-    }
+    if ((s.key == NULL && s.value == NULL) || (t.key == NULL && t.value == NULL))
+        return false;
     if (isFromPlace) {
         vector_push(((struct pn_transition**) vector_to_array(net->transitions))[(size_t) t.value]->preset, &(size_t){ (size_t) s.value });
     }
     else {
         vector_push(((struct pn_transition**) vector_to_array(net->transitions))[(size_t) s.value]->postset, &(size_t){ (size_t) t.value });
     }
-    xmlFree(id);
-    xmlFree(source);
-    xmlFree(target);
-}
-
-static struct petri_net* parse_petri_net(xmlNodePtr curr, struct petri_net* out, Hashtbl(char*, size_t) places, Hashtbl(char*, size_t) transitions) {
-    if (!curr) return out;
-    if (!xmlStrcmp(curr->name, (const xmlChar*) "page"))
-        parse_petri_net(curr->children, out, places, transitions);
-    else if (!xmlStrcmp(curr->name, (const xmlChar*) "place"))
-        parse_place(curr, out, places);
-    else if (!xmlStrcmp(curr->name, (const xmlChar*) "transition"))
-        parse_transition(curr, out, transitions);
-    else if (!xmlStrcmp(curr->name, (const xmlChar*) "arc"))
-        parse_arc(curr, out, places, transitions);
-    else if (!xmlStrcmp(curr->name, (const xmlChar*) "referencePlace") || !xmlStrcmp(curr->name, (const xmlChar*) "referenceTransition"))
-        LOG(WARNING, "Node <%s> will be skipped....", curr->name);
-    return parse_petri_net(curr->next, out, places, transitions);
+    return true;
 }
 
 static inline void free_hashtbl_key(struct hashtbl_element elm, __attribute__((unused))void* unused) {
     free(elm.key);
 }
 
-static struct petri_net* search_petri_net(xmlNodePtr curr) {
-    if (!curr)
-        return NULL;
+/* Streaming parser: the grammar above is read in one forward pass with a xmlTextReader.
+ * Only the path from the root to the current element is kept, skipped subtrees are not
+ * even built. Arcs whose source or target is not read yet are added once the net is read.
+ * The reading stops after the first net, or goes on to every net of the document (all).
+ */
 
-    if (!xmlStrcmp(curr->name, (const xmlChar*) "net")) {
-        xmlChar* type;
-        if (!(type = xmlGetProp(curr, (const xmlChar*) "type")))
-            LOG(WARNING, "%s", "NET node has no type attribute -> search for another net!");
-        else if (xmlStrcmp(type, (const xmlChar*) NET_TYPE)) {
-            LOG(WARNING, "Invalid NET type attribute: expected `" NET_TYPE "' but got `%s': search for another net!", type);
-            xmlFree(type);
-        }
-        else {
-            xmlFree(type);
-            if (!(type = xmlGetProp(curr, (const xmlChar*) "id")))
-                LOG(WARNING, "%s", "NET node has no id attribute -> try to take this net...");
-            else {
-                LOG(INFO, "NET found with id = `%s'", type);
-                xmlFree(type);
-            }
-            struct petri_net* res = petri_net_new();
-            Hashtbl(char*, size_t) places, *transitions;
-            HASHTBL_NEW(places, char*, size_t, );
-            HASHTBL_NEW(transitions, char*, size_t, );
-            res = parse_petri_net(curr->children, res, places, transitions);
-            hashtbl_forall(places, free_hashtbl_key, NULL), hashtbl_forall(transitions, free_hashtbl_key, NULL);
-            return hashtbl_destroy(places), hashtbl_destroy(transitions), res;
+enum element {
+    ELEMENT_PNML, ELEMENT_PAGE, // looking for the net
+    ELEMENT_NET, ELEMENT_NET_PAGE, // in the net
+    ELEMENT_PLACE, ELEMENT_TRANSITION, ELEMENT_ARC,
+    ELEMENT_INITIAL_MARKING, ELEMENT_NAME,
+};
+
+struct pending_arc {
+    xmlChar* id;
+    xmlChar* source;
+    xmlChar* target;
+};
+
+struct stream_parser {
+    xmlTextReaderPtr reader;
+    Vector(enum element) elements; // open elements from the root
+    bool all; // read every net of the document
+    Vector(struct petri_net*) nets; // nets read
+    // net being read (NULL if none)
+    struct petri_net* net;
+    Hashtbl(char*, size_t) places;
+    Hashtbl(char*, size_t) transitions;
+    Vector(struct pending_arc) pending; // arcs with a forward reference
+    // place or transition being read
+    xmlChar* id;
+    size_t marking;
+    xmlChar* name;
+    bool found; // a valid initialMarking (resp. name) was read
+    bool has_child; // the initialMarking (resp. name) being read has an element child
+};
+
+static inline enum element top_element(struct stream_parser* p) {
+    return ((enum element*)vector_to_array(p->elements))[vector_length(p->elements) - 1];
+}
+
+static bool check_root(struct stream_parser* p) {
+    if (xmlStrcmp(xmlTextReaderConstLocalName(p->reader), (const xmlChar*) "pnml")) {
+        LOG(ERROR, "%s", "XML file is not a valid PNML file (missing <pnml> element at root)");
+        return false;
+    }
+    xmlChar* ns = xmlTextReaderLookupNamespace(p->reader, NULL);
+    if (!ns) {
+        LOG(ERROR, "%s", "Invalid PNML file: missing `xmlns' namespace definition in <pnml> root element");
+        return false;
+    }
+    bool ok = !xmlStrcmp(ns, (const xmlChar*) PNML_VERSION);
+    if (!ok)
+        LOG(ERROR, "PNML version not supported: expected `" PNML_VERSION "' but got `%s' as xml namespace definied in root element <pnml>", ns);
+    xmlFree(ns);
+    return ok;
+}
+
+// add the arcs with a forward reference: every node of the net is known
+static void resolve_pending_arcs(struct stream_parser* p) {
+    struct pending_arc* arcs = vector_to_array(p->pending);
+    for (size_t i = 0; i < vector_length(p->pending); i++) {
+        if (!add_arc(p->net, p->places, p->transitions, arcs[i].source, arcs[i].target))
+            LOG(ERROR, "Unable to find source or target of arc `%s'", arcs[i].id);
+        xmlFree(arcs[i].id);
+        xmlFree(arcs[i].source);
+        xmlFree(arcs[i].target);
+    }
+    vector_clear(p->pending);
+}
+
+static void free_pending_arc(void* arc, __attribute__((unused))void* unused) {
+    struct pending_arc* a = arc;
+    xmlFree(a->id);
+    xmlFree(a->source);
+    xmlFree(a->target);
+}
+
+static inline void free_hashtbl_keys(Hashtbl(char*, size_t) h) {
+    if (!h) return;
+    hashtbl_forall(h, free_hashtbl_key, NULL);
+    hashtbl_destroy(h);
+}
+
+// end of the net being read: add it in p->nets if keep
+static void close_net(struct stream_parser* p, bool keep) {
+    if (keep) {
+        resolve_pending_arcs(p);
+        if (!petri_net_intern_labels(p->net))
+            LOG(ERROR, "%s", "Unable to intern the transition labels: not enough memory");
+        if (!vector_push(p->nets, &p->net)) {
+            LOG(ERROR, "NET `%s' skipped: not enough memory", p->net->id ? p->net->id : "");
+            keep = false;
         }
     }
+    if (!keep)
+        petri_net_destroy(p->net);
+    free_hashtbl_keys(p->places);
+    free_hashtbl_keys(p->transitions);
+    p->net = NULL;
+    p->places = p->transitions = NULL;
+}
 
-    struct petri_net* res = NULL;
-    if (!xmlStrcmp(curr->name, (const xmlChar*) "page") && (res = search_petri_net(curr->children)))
-        return res;
+static bool open_net(struct stream_parser* p) {
+    xmlChar* type = xmlTextReaderGetAttribute(p->reader, (const xmlChar*) "type");
+    if (!type) {
+        LOG(WARNING, "%s", "NET node has no type attribute -> search for another net!");
+        return false;
+    }
+    if (xmlStrcmp(type, (const xmlChar*) NET_TYPE)) {
+        LOG(WARNING, "Invalid NET type attribute: expected `" NET_TYPE "' but got `%s': search for another net!", type);
+        xmlFree(type);
+        return false;
+    }
+    xmlFree(type);
+    xmlChar* id = xmlTextReaderGetAttribute(p->reader, (const xmlChar*) "id");
+    if (!id)
+        LOG(WARNING, "%s", "NET node has no id attribute -> try to take this net...");
+    else
+        LOG(INFO, "NET found with id = `%s'", id);
+    p->net = petri_net_new();
+    HASHTBL_NEW(p->places, char*, size_t, );
+    HASHTBL_NEW(p->transitions, char*, size_t, );
+    if (!p->net || !p->places || !p->transitions) {
+        LOG(ERROR, "NET `%s' skipped: not enough memory", id ? (char*) id : "");
+        xmlFree(id);
+        close_net(p, false);
+        return false;
+    }
+    p->net->id = (char*) id;
+    return true;
+}
 
-    return search_petri_net(curr->next);
+static bool open_node(struct stream_parser* p) {
+    p->id = xmlTextReaderGetAttribute(p->reader, (const xmlChar*) "id");
+    p->marking = 0;
+    p->name = NULL;
+    p->found = false;
+    if (!p->id)
+        LOG(ERROR, "%s", "Invalid transition: expected id attribute");
+    return p->id != NULL;
 }
 
-struct petri_net* parse_xml_file(xmlNodePtr root) {
-    if (!root) {
-        LOG(ERROR, "%s", "XML file is empty!");
-        return NULL;
+static void open_arc(struct stream_parser* p) {
+    struct pending_arc arc = {
+        .id = xmlTextReaderGetAttribute(p->reader, (const xmlChar*) "id"),
+        .source = xmlTextReaderGetAttribute(p->reader, (const xmlChar*) "source"),
+        .target = xmlTextReaderGetAttribute(p->reader, (const xmlChar*) "target"),
+    };
+    // the id is kept for the warnings about the children of the arc
+    p->id = arc.id ? xmlStrdup(arc.id) : NULL;
+    if (!arc.id || !arc.source || !arc.target) {
+        LOG(ERROR, "%s", "Invalid transition: expected id, source and target attributes");
+    } else if (!add_arc(p->net, p->places, p->transitions, arc.source, arc.target)) {
+        if (vector_push(p->pending, &arc))
+            return;
+        LOG(ERROR, "Unable to keep arc `%s' for later: not enough memory", arc.id);
     }
-    if (xmlStrcmp(root->name, (const xmlChar*) "pnml")) {
-        LOG(ERROR, "%s", "XML file is not a valid PNML file (missing <pnml> element at root)");
-        return NULL;
+    xmlFree(arc.id);
+    xmlFree(arc.source);
+    xmlFree(arc.target);
+}
+
+// first element in an initialMarking or a name: it must be a non empty <text>
+static void read_value(struct stream_parser* p, enum element parent) {
+    if (p->has_child) return;
+    p->has_child = true;
+    xmlChar* text = NULL;
+    if (!xmlStrcmp(xmlTextReaderConstLocalName(p->reader), (const xmlChar*) "text"))
+        text = xmlTextReaderReadString(p->reader);
+    if (!text || !*text) {
+        LOG(WARNING, parent == ELEMENT_NAME ? "Invalid name in transition `%s'" : "Invalid initialMarking in place `%s'", p->id);
+    } else if (parent == ELEMENT_NAME) {
+        p->name = text;
+        p->found = true;
+        return;
+    } else if (parse_marking_value((char*) text, &p->marking)) {
+        p->found = true;
+    } else {
+        LOG(WARNING, "Invalid initialMarking in place `%s': got `%s' but expected an unsigned integer", p->id, skip_blank((char*) text));
     }
+    xmlFree(text);
+}
 
-    bool found = false;
-    for (xmlNs* ns = root->nsDef; ns; ns = ns->next) {
-        if (ns->prefix == NULL) {
-            if (xmlStrcmp(ns->href, (const xmlChar*) PNML_VERSION)) {
-                LOG(ERROR, "PNML version not supported: expected `" PNML_VERSION "' but got `%s' as xml namespace definied in root element <pnml>", ns->href);
-                return NULL;
+// element the reader is on: return the element to open or -1 if its subtree is skipped
+static int open_element(struct stream_parser* p) {
+    const xmlChar* name = xmlTextReaderConstLocalName(p->reader);
+    enum element parent = top_element(p);
+    switch (parent) {
+        case ELEMENT_PNML:
+        case ELEMENT_PAGE:
+            if (!xmlStrcmp(name, (const xmlChar*) "page"))
+                return ELEMENT_PAGE;
+            if (!xmlStrcmp(name, (const xmlChar*) "net") && open_net(p))
+                return ELEMENT_NET;
+            return -1;
+        case ELEMENT_NET:
+        case ELEMENT_NET_PAGE:
+            if (!xmlStrcmp(name, (const xmlChar*) "page"))
+                return ELEMENT_NET_PAGE;
+            if (!xmlStrcmp(name, (const xmlChar*) "place"))
+                return open_node(p) ? ELEMENT_PLACE : -1;
+            if (!xmlStrcmp(name, (const xmlChar*) "transition"))
+                return open_node(p) ? ELEMENT_TRANSITION : -1;
+            if (!xmlStrcmp(name, (const xmlChar*) "arc")) {
+                open_arc(p);
+                return ELEMENT_ARC;
             }
-            found = true;
+            if (!xmlStrcmp(name, (const xmlChar*) "referencePlace") || !xmlStrcmp(name, (const xmlChar*) "referenceTransition"))
+                LOG(WARNING, "Node <%s> will be skipped....", name);
+            return -1;
+        case ELEMENT_PLACE:
+            if (p->found || xmlStrcmp(name, (const xmlChar*) "initialMarking"))
+                return -1;
+            p->has_child = false;
+            return ELEMENT_INITIAL_MARKING;
+        case ELEMENT_TRANSITION:
+            if (p->found || xmlStrcmp(name, (const xmlChar*) "name"))
+                return -1;
+            p->has_child = false;
+            return ELEMENT_NAME;
+        case ELEMENT_ARC:
+            if (!xmlStrcmp(name, (const xmlChar*) "inscription"))
+                LOG(WARNING, "Inscription found in arc `%s': inscriptions are ignored...", p->id);
+            return -1;
+        case ELEMENT_INITIAL_MARKING:
+        case ELEMENT_NAME:
+            read_value(p, parent);
+            return -1;
+    }
+    return -1;
+}
+
+static void close_element(struct stream_parser* p) {
+    enum element e = top_element(p);
+    vector_pop(p->elements);
+    switch (e) {
+        case ELEMENT_NET:
+            close_net(p, true);
+            break;
+        case ELEMENT_PLACE: {
+            size_t place = vector_length(p->net->marking);
+            vector_push(p->net->marking, &p->marking);
+            if (!hashtbl_add(p->places, p->id, (void*) place, true))
+                LOG(ERROR, "The place `%s' cannot be added in the places hashtable...", p->id);
+            p->id = NULL;
             break;
         }
+        case ELEMENT_TRANSITION:
+            add_transition(p->net, p->transitions, p->id, p->name);
+            p->id = p->name = NULL;
+            break;
+        case ELEMENT_ARC:
+            xmlFree(p->id);
+            p->id = NULL;
+            break;
+        case ELEMENT_INITIAL_MARKING:
+        case ELEMENT_NAME:
+            if (!p->has_child)
+                LOG(WARNING, e == ELEMENT_NAME ? "Invalid name in transition `%s'" : "Invalid initialMarking in place `%s'", p->id);
+            break;
+        default:
+            break;
     }
-    if (!found) {
-        LOG(ERROR, "%s", "Invalid PNML file: missing `xmlns' namespace definition in <pnml> root element");
+}
+
+static inline bool reading_done(struct stream_parser* p) {
+    return !p->all && !vector_is_empty(p->nets);
+}
+
+// read the nets of the file (return false on error)
+static bool read_nets(struct stream_parser* p, __attribute__((unused))const char* path) {
+    int ret = xmlTextReaderRead(p->reader);
+    while (ret == 1 && !reading_done(p)) {
+        bool skip = false;
+        switch (xmlTextReaderNodeType(p->reader)) {
+            case XML_READER_TYPE_ELEMENT: {
+                int e;
+                if (vector_is_empty(p->elements)) {
+                    if (!check_root(p))
+                        return false;
+                    e = ELEMENT_PNML;
+                }
+                else
+                    e = open_element(p);
+                if ((skip = e < 0))
+                    break;
+                if (!vector_push(p->elements, &(enum element){ (enum element) e })) {
+                    LOG(ERROR, "%s", "Unable to parse the PNML file: not enough memory");
+                    return false;
+                }
+                if (xmlTextReaderIsEmptyElement(p->reader))
+                    close_element(p);
+                break;
+            }
+            case XML_READER_TYPE_END_ELEMENT:
+                close_element(p);
+                break;
+            default:
+                break;
+        }
+        if (!reading_done(p))
+            ret = skip ? xmlTextReaderNext(p->reader) : xmlTextReaderRead(p->reader);
+    }
+    if (ret < 0) {
+        LOG(ERROR, "Cannot parse xml file `%s'", path);
+        return false;
+    }
+    return true;
+}
+
+static void destroy_net(void* net, __attribute__((unused))void* unused) {
+    petri_net_destroy(*(struct petri_net**) net);
+}
+
+static struct vector* parse_pnml(const char* path, bool all) {
+    struct stream_parser p = {
+        .reader = xmlReaderForFile(path, NULL, XML_PARSE_NONET),
+        .elements = vector_new(sizeof(enum element), 0),
+        .pending = vector_new(sizeof(struct pending_arc), 0),
+        .nets = vector_new(sizeof(struct petri_net*), 0),
+        .all = all,
+    };
+    bool ok = p.reader && p.elements && p.pending && p.nets;
+    if (!ok)
+        LOG(ERROR, "Cannot parse xml file `%s'", path);
+    else
+        ok = read_nets(&p, path);
+
+    if (p.net)
+        close_net(&p, false);
+    if (p.reader) xmlFreeTextReader(p.reader);
+    if (p.elements) vector_destroy(p.elements);
+    if (p.pending) {
+        vector_forall(p.pending, free_pending_arc, NULL);
+        vector_destroy(p.pending);
+    }
+    xmlFree(p.id);
+    xmlFree(p.name);
+    if (!ok && p.nets) {
+        vector_forall(p.nets, destroy_net, NULL);
+        vector_destroy(p.nets);
         return NULL;
     }
+    return p.nets;
+}
+
+struct petri_net* parse_pnml_file(const char* path) {
+    struct vector* nets = parse_pnml(path, false);
+    if (!nets)
+        return NULL;
+    struct petri_net* net = vector_is_empty(nets) ? NULL : *(struct petri_net**) vector_pop(nets);
+    vector_destroy(nets);
+    return net;
+}
 
-    return search_petri_net(root->children);
+Vector(struct petri_net*) parse_pnml_nets(const char* path) {
+    return parse_pnml(path, true);
 }
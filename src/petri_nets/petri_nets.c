@@ -1,4 +1,5 @@
 #include "petri_nets.h"
+#include "hashtbl.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -8,6 +9,7 @@ struct pn_transition* pn_transition_new(const char* label) {
     struct pn_transition* t = malloc(sizeof(*t));
     if (!t) return NULL;
     t->label = strdup(label);
+    t->label_id = 0;
     if (!t->label) {
         free(t);
         return NULL;
@@ -42,6 +44,7 @@ void pn_transition_destroy(struct pn_transition* t) {
 struct petri_net* petri_net_new(void) {
     struct petri_net* pn = malloc(sizeof(*pn));
     if (!pn) return NULL;
+    pn->id = NULL;
     pn->marking = vector_new(sizeof(size_t), 0);
     if (!pn->marking) {
         free(pn);
@@ -53,6 +56,13 @@ struct petri_net* petri_net_new(void) {
         free(pn);
         return NULL;
     }
+    pn->labels = vector_new(sizeof(char*), 0);
+    if (!pn->labels) {
+        vector_destroy(pn->transitions);
+        vector_destroy(pn->marking);
+        free(pn);
+        return NULL;
+    }
     return pn;
 }
 
@@ -69,6 +79,9 @@ void petri_net_destroy(struct petri_net* pn) {
         vector_forall(pn->transitions, free_pn_transition, NULL);
         vector_destroy(pn->transitions);
     }
+    if (pn->labels)
+        vector_destroy(pn->labels);
+    free(pn->id);
     free(pn);
 }
 
@@ -106,84 +119,25 @@ void pn_pretty_print(struct petri_net* pn) {
     printf("\n");
 }
 
-struct vector* marking_copy(struct vector* marking) {
-    struct vector* r = vector_new(sizeof(size_t), vector_length(marking));
-    if (r) {
-        for (size_t i = 0; i < vector_length(marking); i++)
-            vector_push(r, ((size_t*)vector_to_array(marking)) + i);
-    }
-    return r;
-}
-
-struct vector* pn_start_transition(struct vector* transitions, struct vector* marking, size_t transition_idx) {
-    if (!transitions || !marking || vector_length(transitions) <= transition_idx)
-        return NULL;
-    struct vector* r = marking_copy(marking);
-    struct vector* preset = (((struct pn_transition**)vector_to_array(transitions))[transition_idx])->preset;
-    for (size_t i = 0; i < vector_length(preset); i++) {
-        size_t k = ((size_t*)vector_to_array(preset))[i];
-        if (k >= vector_length(marking) || !((size_t*)vector_to_array(r))[k]) {
-            vector_destroy(r);
-            return NULL;
-        }
-        ((size_t*)vector_to_array(r))[k]-=1;
-    }
-    return r;
-}
-
-size_t pn_transition_is_activable(struct vector* transitions, struct vector* marking, size_t transition_idx) {
-    if (!transitions || !marking || vector_length(transitions) <= transition_idx)
-        return 0;
-    struct vector* copy = marking_copy(marking);
-    size_t count = 0;
-    struct vector* preset = (((struct pn_transition**)vector_to_array(transitions))[transition_idx])->preset;
-    for (;; count++) {
-        for (size_t i = 0; i < vector_length(preset); i++) {
-            size_t k = ((size_t*)vector_to_array(preset))[i];
-            if (k >= vector_length(marking) || !((size_t*)vector_to_array(copy))[k]) {
-                vector_destroy(copy);
-                return count;
-            }
-            ((size_t*)vector_to_array(copy))[k]-=1;
+bool petri_net_intern_labels(struct petri_net* pn) {
+    Hashtbl(char*, size_t) ids;
+    HASHTBL_NEW(ids, char*, size_t, );
+    if (!ids) return false;
+    vector_clear(pn->labels);
+    struct pn_transition** transitions = vector_to_array(pn->transitions);
+    for (size_t i = 0; i < vector_length(pn->transitions); i++) {
+        struct hashtbl_element e = hashtbl_find(ids, transitions[i]->label);
+        if (e.key) {
+            transitions[i]->label_id = (size_t) e.value;
+            continue;
         }
-    }
-    vector_destroy(copy);
-    return count;
-}
-
-struct vector* pn_end_transition(struct vector* transitions, struct vector* marking, size_t transition_idx) {
-    if (!transitions || !marking || vector_length(transitions) <= transition_idx)
-        return NULL;
-    struct vector* r = marking_copy(marking);
-    struct vector* postset = (((struct pn_transition**)vector_to_array(transitions))[transition_idx])->postset;
-    for (size_t i = 0; i < vector_length(postset); i++) {
-        size_t k = ((size_t*)vector_to_array(postset))[i];
-        if (k >= vector_length(marking)) {
-            vector_destroy(r);
-            return NULL;
+        transitions[i]->label_id = vector_length(pn->labels);
+        if (!vector_push(pn->labels, &transitions[i]->label)
+            || !hashtbl_add(ids, transitions[i]->label, (void*) transitions[i]->label_id, false)) {
+            hashtbl_destroy(ids);
+            return false;
         }
-        ((size_t*)vector_to_array(r))[k]+=1;
-    }
-    return r;
-}
-
-size_t marking_hash(const void* m) {
-    const size_t* key = vector_to_array((struct vector*)m);
-    size_t l = vector_length((struct vector*)m);
-    size_t hash = l;
-    const size_t* end = key + l;
-    for(; key != end; key++) {
-        size_t x = *key;
-        x = ((x >> 16) ^ x) * 0x45d9f3b;
-        x = ((x >> 16) ^ x) * 0x45d9f3b;
-        x = (x >> 16) ^ x;
-        hash ^= x + 0x9e3779b9 + (hash << 6) + (hash >> 2);
     }
-    return hash;
-}
-
-bool is_same_marking(struct vector* m1, struct vector* m2) {
-    if (vector_length(m1) != vector_length(m2))
-        return false;
-    return !memcmp(vector_to_array(m1), vector_to_array(m2), vector_length(m1));
+    hashtbl_destroy(ids);
+    return true;
 }
@@ -0,0 +1,124 @@
+#define _POSIX_C_SOURCE 200809L
+#include "stats.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// blocks of the threads, chained as they are registered
+struct _block {
+    struct stats stats;
+    struct _block* next;
+};
+
+__thread struct stats* stats_local = NULL;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct _block* blocks = NULL;
+static struct stats overflow; // threads whose block cannot be allocated
+static double phase_starts[STATS_NB_PHASES];
+static double phase_durations[STATS_NB_PHASES];
+static const char* phase_names[STATS_NB_PHASES] = { [STATS_PARSE] = "parse", [STATS_CONVERT] = "convert", [STATS_PRINT] = "print" };
+
+struct stats* stats_register(void) {
+    struct _block* b = calloc(1, sizeof(*b));
+    if (!b)
+        return stats_local = &overflow;
+    pthread_mutex_lock(&lock);
+    b->next = blocks;
+    blocks = b;
+    pthread_mutex_unlock(&lock);
+    return stats_local = &b->stats;
+}
+
+static double _now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double) t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void stats_phase_start(enum stats_phase phase) {
+    phase_starts[phase] = _now();
+}
+
+void stats_phase_end(enum stats_phase phase) {
+    phase_durations[phase] += _now() - phase_starts[phase];
+}
+
+static void _add(struct stats* sum, const struct stats* s) {
+    for (size_t d = 0; d < STATS_MAX_DIMS; d++)
+        sum->cells_per_dim[d] += s->cells_per_dim[d];
+    for (size_t i = 0; i < STATS_PROBE_LENGTHS; i++)
+        sum->probe_lengths[i] += s->probe_lengths[i];
+    sum->successors += s->successors;
+    sum->new_successors += s->new_successors;
+    sum->filter_calls += s->filter_calls;
+    sum->filter_rejections += s->filter_rejections;
+    sum->filter_probes += s->filter_probes;
+    sum->max_depth = s->max_depth > sum->max_depth ? s->max_depth : sum->max_depth;
+    sum->lookups += s->lookups;
+    sum->key_compares += s->key_compares;
+    sum->table_resizes += s->table_resizes;
+    sum->transitions_started += s->transitions_started;
+    sum->transitions_ended += s->transitions_ended;
+    sum->markings_committed += s->markings_committed;
+    sum->enabled_updates += s->enabled_updates;
+}
+
+// JSON array of the first n values of a (at least one), without its trailing zeros
+static void _write_array(FILE* f, const size_t* a, size_t n) {
+    while (n > 1 && !a[n - 1])
+        n--;
+    fprintf(f, "[");
+    for (size_t i = 0; i < n; i++)
+        fprintf(f, "%s%zu", i ? ", " : "", a[i]);
+    fprintf(f, "]");
+}
+
+bool stats_write(const char* path) {
+    struct stats s = { 0 };
+    pthread_mutex_lock(&lock);
+    for (struct _block* b = blocks; b; b = b->next)
+        _add(&s, &b->stats);
+    pthread_mutex_unlock(&lock);
+    _add(&s, &overflow);
+    size_t nb_cells = 0;
+    for (size_t d = 0; d < STATS_MAX_DIMS; d++)
+        nb_cells += s.cells_per_dim[d];
+    struct rusage usage = { 0 };
+    getrusage(RUSAGE_SELF, &usage);
+
+    FILE* f = fopen(path, "w");
+    if (!f)
+        return false;
+    fprintf(f, "{\n  \"phases_s\": {");
+    for (size_t p = 0; p < STATS_NB_PHASES; p++)
+        fprintf(f, "%s\"%s\": %.6f", p ? ", " : " ", phase_names[p], phase_durations[p]);
+    fprintf(f, " },\n  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+    fprintf(f, "  \"cells\": %zu,\n  \"cells_per_dim\": ", nb_cells);
+    _write_array(f, s.cells_per_dim, STATS_MAX_DIMS);
+    fprintf(f, ",\n  \"successors\": { \"generated\": %zu, \"new\": %zu },\n", s.successors, s.new_successors);
+    fprintf(f, "  \"filter\": { \"calls\": %zu, \"rejections\": %zu, \"probes\": %zu },\n", s.filter_calls, s.filter_rejections, s.filter_probes);
+    fprintf(f, "  \"max_depth\": %zu,\n", s.max_depth);
+    fprintf(f, "  \"hashtbl\": { \"lookups\": %zu, \"key_compares\": %zu, \"resizes\": %zu, \"probe_lengths\": ",
+            s.lookups, s.key_compares, s.table_resizes);
+    _write_array(f, s.probe_lengths, STATS_PROBE_LENGTHS);
+    fprintf(f, " },\n  \"markings\": { \"transitions_started\": %zu, \"transitions_ended\": %zu, \"committed\": %zu, \"enabled_updates\": %zu }\n}\n",
+            s.transitions_started, s.transitions_ended, s.markings_committed, s.enabled_updates);
+    bool ok = !ferror(f);
+    return !fclose(f) && ok;
+}
+
+void stats_release(void) {
+    pthread_mutex_lock(&lock);
+    while (blocks) {
+        struct _block* next = blocks->next;
+        free(blocks);
+        blocks = next;
+    }
+    pthread_mutex_unlock(&lock);
+    // the other threads are done: only the block of the calling thread was still in use
+    stats_local = NULL;
+}
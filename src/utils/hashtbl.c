@@ -1,25 +1,50 @@
 #include "hashtbl.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-enum hashtbl_data_state {
-    FREED,
-    OCCUPED,
-    DELETED,
+#include "stats.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Open addressing in the style of SwissTable: the capacity is a power of two and every slot has a
+// control byte, either EMPTY, DELETED or 7 bits of the hash (tag) of its key. The control
+// bytes are stored apart from the slots and a probe compares the tags of a whole group of
+// GROUP_WIDTH slots at once, so keys are only compared when their tag matches.
+// The first GROUP_WIDTH control bytes are cloned after the last one: a group can start anywhere.
+//
+// Once no slot is left to insert in, the elements are moved to a new table: twice larger, or of
+// the same size if most of the used slots are DELETED ones (the new table has none of them).
+// The move is done at once, or MIGRATION_STEP slots of the old table at a time on each call in
+// incremental mode. Until all of them are moved, lookups search both tables.
+
+#define GROUP_WIDTH 16
+#define CTRL_EMPTY ((uint8_t) 0x80)
+#define CTRL_DELETED ((uint8_t) 0xfe)
+#define MIN_CAPACITY GROUP_WIDTH
+// enough for the migration to end long before the new table is full
+#define MIGRATION_STEP (2 * GROUP_WIDTH)
+
+struct _table {
+    uint8_t* ctrl; // capacity + GROUP_WIDTH control bytes
+    unsigned char* slots; // capacity slots of slot_size bytes: key (or pointer to it), value
+    size_t capacity;
+    size_t mask;
+    size_t growth_left; // slots which can still become used (full or deleted) before a resize
 };
 
 struct hashtbl {
-    struct hashtbl_data {
-        void* key;
-        void* value;
-        size_t hash_value;
-        enum hashtbl_data_state state;
-    }* data;
-    size_t capacity;
-    size_t sizeof_key;
-    size_t sizeof_value;
-    size_t nb_free_nodes;
+    struct _table table;
+    struct _table old; // being moved to table (ctrl is NULL if none)
+    size_t migrated; // slots of old already moved
+    size_t nb_elements;
+    size_t key_size; // bytes of the key in a slot
+    size_t slot_size;
+    bool inline_keys;
+    bool incremental;
     size_t (*hash_func)(const void* key);
     size_t (*cmp_func)(const void* key1, const void* key2);
 };
@@ -43,203 +68,348 @@ size_t hashtbl_default_hashfunc(const void* key) {
     return hash;
 }
 
+// bit i is set if the control byte i of the group matches
+typedef uint32_t _bitmask;
+
+#ifdef __SSE2__
+static inline _bitmask _match(const uint8_t* group, uint8_t ctrl) {
+    __m128i g = _mm_loadu_si128((const __m128i*) group);
+    return (_bitmask) _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char) ctrl)));
+}
+
+// empty or deleted
+static inline _bitmask _match_free(const uint8_t* group) {
+    return (_bitmask) _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) group));
+}
+#else
+static inline _bitmask _match(const uint8_t* group, uint8_t ctrl) {
+    _bitmask m = 0;
+    for (size_t i = 0; i < GROUP_WIDTH; i++)
+        m |= (_bitmask)(group[i] == ctrl) << i;
+    return m;
+}
+
+static inline _bitmask _match_free(const uint8_t* group) {
+    _bitmask m = 0;
+    for (size_t i = 0; i < GROUP_WIDTH; i++)
+        m |= (_bitmask)(group[i] >> 7) << i;
+    return m;
+}
+#endif
+
+// the hash functions of the users are not always well distributed in their low bits
+static inline uint64_t _mix(size_t hash) {
+    uint64_t x = (uint64_t) hash * 0x9e3779b97f4a7c15ull;
+    return x ^ (x >> 32);
+}
+
+static inline uint8_t _tag(uint64_t x) {
+    return (uint8_t)(x >> 57);
+}
+
+static inline unsigned char* _slot(struct hashtbl* h, struct _table* t, size_t i) {
+    return t->slots + i * h->slot_size;
+}
+
+static inline void* _key(struct hashtbl* h, unsigned char* slot) {
+    if (h->inline_keys)
+        return slot;
+    void* key;
+    memcpy(&key, slot, sizeof(key));
+    return key;
+}
+
+static inline void* _value(struct hashtbl* h, unsigned char* slot) {
+    void* value;
+    memcpy(&value, slot + h->key_size, sizeof(value));
+    return value;
+}
+
+static inline void _set_ctrl(struct _table* t, size_t i, uint8_t ctrl) {
+    t->ctrl[i] = ctrl;
+    if (i < GROUP_WIDTH)
+        t->ctrl[t->capacity + i] = ctrl;
+}
+
+static inline void _set_slot(struct hashtbl* h, unsigned char* slot, const void* key, void* value) {
+    if (h->inline_keys) {
+        if (slot != key)
+            memcpy(slot, key, h->key_size);
+    } else {
+        memcpy(slot, &key, sizeof(key));
+    }
+    memcpy(slot + h->key_size, &value, sizeof(value));
+}
+
+static inline struct hashtbl_element _element(struct hashtbl* h, unsigned char* slot) {
+    if (!slot)
+        return (struct hashtbl_element){ .key = NULL, .value = NULL };
+    return (struct hashtbl_element){ .key = _key(h, slot), .value = _value(h, slot) };
+}
+
+// Probe sequence: groups at triangular offsets from the home position, which visits every group
+// of the table once the capacity is a power of two.
+struct _probe {
+    size_t offset;
+    size_t index;
+};
+
+static inline struct _probe _probe_start(struct _table* t, uint64_t x) {
+    return (struct _probe){ .offset = (size_t)(x >> 7) & t->mask, .index = 0 };
+}
+
+static inline void _probe_next(struct _table* t, struct _probe* p) {
+    p->index += GROUP_WIDTH;
+    p->offset = (p->offset + p->index) & t->mask;
+}
+
+// index in t of the slot holding a key equal to key and accepted by the filter (if any), capacity if none
+static size_t _find_in(struct hashtbl* h, struct _table* t, const void* key, uint64_t x, bool (*filter)(void* value, void* extra_args), void* extra_args) {
+    uint8_t tag = _tag(x);
+    STATS_INC(lookups);
+    for (struct _probe p = _probe_start(t, x); ; _probe_next(t, &p)) {
+        const uint8_t* group = t->ctrl + p.offset;
+        for (_bitmask m = _match(group, tag); m; m &= m - 1) {
+            size_t i = (p.offset + (size_t) __builtin_ctz(m)) & t->mask;
+            unsigned char* slot = _slot(h, t, i);
+            STATS_INC(key_compares);
+            if (!h->cmp_func(key, _key(h, slot)) && (!filter || filter(_value(h, slot), extra_args))) {
+                STATS_HISTOGRAM(probe_lengths, p.index / GROUP_WIDTH + 1);
+                return i;
+            }
+        }
+        if (_match(group, CTRL_EMPTY)) {
+            STATS_HISTOGRAM(probe_lengths, p.index / GROUP_WIDTH + 1);
+            return t->capacity;
+        }
+    }
+}
+
+// first empty or deleted slot of the probe sequence of x
+static size_t _find_free(struct _table* t, uint64_t x) {
+    for (struct _probe p = _probe_start(t, x); ; _probe_next(t, &p)) {
+        _bitmask m = _match_free(t->ctrl + p.offset);
+        if (m)
+            return (p.offset + (size_t) __builtin_ctz(m)) & t->mask;
+    }
+}
+
+static inline size_t _max_load(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+static bool _alloc(struct hashtbl* h, struct _table* t, size_t capacity) {
+    if (capacity > (SIZE_MAX - GROUP_WIDTH) / h->slot_size)
+        return false;
+    uint8_t* ctrl = malloc(capacity + GROUP_WIDTH);
+    unsigned char* slots = malloc(capacity * h->slot_size);
+    if (!ctrl || !slots) {
+        free(ctrl);
+        free(slots);
+        return false;
+    }
+    memset(ctrl, CTRL_EMPTY, capacity + GROUP_WIDTH);
+    *t = (struct _table){
+        .ctrl = ctrl,
+        .slots = slots,
+        .capacity = capacity,
+        .mask = capacity - 1,
+        .growth_left = _max_load(capacity),
+    };
+    return true;
+}
+
+static void _free_table(struct _table* t) {
+    free(t->ctrl);
+    free(t->slots);
+    t->ctrl = NULL;
+    t->slots = NULL;
+}
+
 struct hashtbl* hashtbl_new(size_t sizeof_key, size_t sizeof_value, struct hashtbl_creation_args* extra_args) {
+    (void) sizeof_value; // values are stored as void*
     struct hashtbl* h = malloc(sizeof(*h));
     if (!h) return NULL;
-    if (!(h->data = calloc(extra_args->capacity, sizeof(*(h->data))))) {
+    h->inline_keys = extra_args->inline_keys;
+    h->incremental = extra_args->incremental;
+    // keep the values aligned
+    h->key_size = h->inline_keys ? (sizeof_key + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*) : sizeof(void*);
+    h->slot_size = h->key_size + sizeof(void*);
+    h->cmp_func = extra_args->cmp_func;
+    h->hash_func = extra_args->hash_func;
+    h->old = (struct _table){ .ctrl = NULL };
+    h->migrated = 0;
+    h->nb_elements = 0;
+    size_t capacity = MIN_CAPACITY;
+    while (capacity < extra_args->capacity && capacity <= SIZE_MAX / 2)
+        capacity *= 2;
+    if (!_alloc(h, &h->table, capacity)) {
         free(h);
         return NULL;
     }
-    h->capacity = extra_args->capacity;
-    h->cmp_func = extra_args->cmp_func;
-    h->hash_func = extra_args->hash_func;
-    h->nb_free_nodes = h->capacity;
-    h->sizeof_key = sizeof_key;
-    h->sizeof_value = sizeof_value;
     return h;
 }
 
+// move up to n slots of the old table to the new one
+static void _migrate(struct hashtbl* h, size_t n) {
+    if (!h->old.ctrl)
+        return;
+    size_t end = h->old.capacity - h->migrated < n ? h->old.capacity : h->migrated + n;
+    for (; h->migrated < end; h->migrated++) {
+        size_t i = h->migrated;
+        if (h->old.ctrl[i] & 0x80)
+            continue;
+        unsigned char* slot = _slot(h, &h->old, i);
+        uint64_t x = _mix(h->hash_func(_key(h, slot)));
+        size_t j = _find_free(&h->table, x);
+        h->table.growth_left -= h->table.ctrl[j] == CTRL_EMPTY;
+        _set_ctrl(&h->table, j, _tag(x));
+        memcpy(_slot(h, &h->table, j), slot, h->slot_size);
+        // not found by the lookups in the old table anymore
+        _set_ctrl(&h->old, i, CTRL_DELETED);
+    }
+    if (h->migrated == h->old.capacity)
+        _free_table(&h->old);
+}
+
+// start moving the elements to a new table (all of them if not incremental)
 static bool hashtbl_expand(struct hashtbl* h) {
-    if (h->nb_free_nodes <= h->capacity / 4) {
-        struct hashtbl_data* new_data = calloc(2 * h->capacity, sizeof(*new_data));
-        if (!new_data)
+    // a migration left would need three tables
+    _migrate(h, SIZE_MAX);
+    // the deleted slots are dropped: grow only if the elements alone use half the load
+    size_t capacity = h->table.capacity;
+    if (h->nb_elements >= _max_load(capacity) / 2) {
+        if (capacity > SIZE_MAX / 2)
             return false;
-        size_t new_cap = h->capacity * 2;
-        for (size_t i = 0; i < h->capacity; i++) {
-            struct hashtbl_data d = h->data[i];
-            if (d.state == OCCUPED) {
-                size_t h = d.hash_value;
-                for (; new_data[h % new_cap].state == OCCUPED; h++);
-                new_data[h % new_cap] = d;
-            }
-        }
-        h->nb_free_nodes = new_cap - (h->capacity - h->nb_free_nodes);
-        h->capacity = new_cap;
-        free(h->data);
-        h->data = new_data;
+        capacity *= 2;
     }
+    struct _table t;
+    if (!_alloc(h, &t, capacity))
+        return false;
+    STATS_INC(table_resizes);
+    h->old = h->table;
+    h->table = t;
+    h->migrated = 0;
+    _migrate(h, h->incremental ? MIGRATION_STEP : SIZE_MAX);
     return true;
 }
 
-bool hashtbl_add(struct hashtbl* h, void* key, void* value, bool is_unique) {
-    if (!hashtbl_expand(h))
-        return false;
-    size_t hash = h->hash_func(key);
-    size_t h2 = hash;
-    for (; h->data[h2 % h->capacity].state == OCCUPED; h2++) {
-        if (is_unique && !h->cmp_func(key, h->data[h2 % h->capacity].key))
+// slot holding a key equal to key and accepted by the filter (NULL if none), in the table *t
+static unsigned char* _find(struct hashtbl* h, const void* key, uint64_t x, bool (*filter)(void* value, void* extra_args), void* extra_args, struct _table** t) {
+    _migrate(h, MIGRATION_STEP);
+    size_t i = _find_in(h, &h->table, key, x, filter, extra_args);
+    if (i != h->table.capacity)
+        return *t = &h->table, _slot(h, &h->table, i);
+    if (!h->old.ctrl)
+        return NULL;
+    i = _find_in(h, &h->old, key, x, filter, extra_args);
+    if (i != h->old.capacity)
+        return *t = &h->old, _slot(h, &h->old, i);
+    return NULL;
+}
+
+// insert in a free slot of the new table, resizing it if needed
+static bool _insert(struct hashtbl* h, const void* key, void* value, uint64_t x) {
+    size_t i = _find_free(&h->table, x);
+    if (h->table.ctrl[i] == CTRL_EMPTY && !h->table.growth_left) {
+        if (!hashtbl_expand(h))
             return false;
+        i = _find_free(&h->table, x);
     }
-    if (is_unique) {
-        for (size_t hh = h2, i = h2 - hash; h->data[hh % h->capacity].state != FREED && i < h->capacity; hh++, i++) {
-            if (h->data[hh % h->capacity].state == OCCUPED && !h->cmp_func(key, h->data[hh % h->capacity].key))
-                return false;
-        }
-    }
-    h->data[h2 % h->capacity] = (struct hashtbl_data){
-        .state = OCCUPED,
-        .key = key,
-        .hash_value = hash,
-        .value = value,
-    };
-    (h->nb_free_nodes)--;
+    h->table.growth_left -= h->table.ctrl[i] == CTRL_EMPTY;
+    _set_ctrl(&h->table, i, _tag(x));
+    _set_slot(h, _slot(h, &h->table, i), key, value);
+    h->nb_elements++;
     return true;
 }
 
-struct hashtbl_element hashtbl_remove(struct hashtbl* h, void* key) {
-    size_t hash = h->hash_func(key);
-    size_t i = 0;
-    for (struct hashtbl_data d = h->data[hash % h->capacity]; d.state != FREED && i != h->capacity; d = h->data[(++hash) % h->capacity], i++) {
-        if (d.state == OCCUPED && !h->cmp_func(key, d.key)) {
-            (h->nb_free_nodes)++;
-            h->data[hash % h->capacity].state = DELETED;
-            return (struct hashtbl_element){
-                .key = d.key, .value = d.value,
-            };
-        }
+bool hashtbl_add(struct hashtbl* h, void* key, void* value, bool is_unique) {
+    uint64_t x = _mix(h->hash_func(key));
+    struct _table* t;
+    if (is_unique && _find(h, key, x, NULL, NULL, &t))
+        return false;
+    if (!is_unique)
+        _migrate(h, MIGRATION_STEP);
+    return _insert(h, key, value, x);
+}
+
+// A slot whose group never was full (an empty slot within GROUP_WIDTH before and after it) was
+// never skipped by a probe: it can be emptied instead of leaving a deleted slot.
+static void _erase(struct _table* t, size_t i) {
+    _bitmask after = _match(t->ctrl + i, CTRL_EMPTY);
+    _bitmask before = _match(t->ctrl + ((i - GROUP_WIDTH) & t->mask), CTRL_EMPTY);
+    if (after && before && (size_t) __builtin_ctz(after) + (size_t)(__builtin_clz(before) - (32 - GROUP_WIDTH)) < GROUP_WIDTH) {
+        _set_ctrl(t, i, CTRL_EMPTY);
+        t->growth_left++;
+    } else {
+        _set_ctrl(t, i, CTRL_DELETED);
     }
-    return (struct hashtbl_element){
-        .key = NULL, .value = NULL,
-    };
+}
+
+struct hashtbl_element hashtbl_remove(struct hashtbl* h, void* key) {
+    struct _table* t;
+    unsigned char* slot = _find(h, key, _mix(h->hash_func(key)), NULL, NULL, &t);
+    if (!slot)
+        return (struct hashtbl_element){ .key = NULL, .value = NULL };
+    _erase(t, (size_t)(slot - t->slots) / h->slot_size);
+    h->nb_elements--;
+    return _element(h, slot);
 }
 
 struct hashtbl_element hashtbl_find(struct hashtbl* h, void* key) {
-    size_t hash = h->hash_func(key);
-    size_t i = 0;
-    for (struct hashtbl_data d = h->data[hash % h->capacity]; d.state != FREED && i != h->capacity; d = h->data[(++hash) % h->capacity], i++) {
-        if (d.state == OCCUPED && !h->cmp_func(key, d.key)) {
-            return (struct hashtbl_element){
-                .key = d.key, .value = d.value,
-            };
-        }
-    }
-    return (struct hashtbl_element){
-        .key = NULL, .value = NULL,
-    };
+    struct _table* t;
+    return _element(h, _find(h, key, _mix(h->hash_func(key)), NULL, NULL, &t));
 }
 
 struct hashtbl_element hashtbl_find_filter(struct hashtbl* h, void* key, bool (*filter)(void* value, void* extra_args), void* extra_args) {
-    size_t hash = h->hash_func(key);
-    size_t i = 0;
-    for (struct hashtbl_data d = h->data[hash % h->capacity]; d.state != FREED && i != h->capacity; d = h->data[(++hash) % h->capacity], i++) {
-        if (d.state == OCCUPED && !h->cmp_func(key, d.key) && filter(d.value, extra_args)) {
-            return (struct hashtbl_element){
-                .key = d.key, .value = d.value,
-            };
-        }
-    }
-    return (struct hashtbl_element){
-        .key = NULL, .value = NULL,
-    };
+    struct _table* t;
+    return _element(h, _find(h, key, _mix(h->hash_func(key)), filter, extra_args, &t));
 }
 
 struct hashtbl_element hashtbl_update(struct hashtbl* h, void* key, void* value) {
-    if (!hashtbl_expand(h))
-        return (struct hashtbl_element){ .key = ERROR_PTR, .value = ERROR_PTR };
-    size_t hash = h->hash_func(key);
-    size_t h2 = hash;
-    for (; h->data[h2 % h->capacity].state == OCCUPED; h2++) {
-        if (!h->cmp_func(key, h->data[h2 % h->capacity].key)) {
-            struct hashtbl_element res = (struct hashtbl_element){
-                .key = h->data[h2 % h->capacity].key,
-                .value = h->data[h2 % h->capacity].value,
-            };
-            h->data[h2 % h->capacity].key = key;
-            h->data[h2 % h->capacity].value = value;
-            return res;
-        }
-    }
-    for (size_t hh = h2, i = h2 - hash; h->data[hh % h->capacity].state != FREED && i < h->capacity; hh++, i++) {
-        if (h->data[hh % h->capacity].state == OCCUPED && !h->cmp_func(key, h->data[hh % h->capacity].key)) {
-            struct hashtbl_element res = (struct hashtbl_element){
-                .key = h->data[hh % h->capacity].key,
-                .value = h->data[hh % h->capacity].value,
-            };
-            h->data[hh % h->capacity].key = key;
-            h->data[hh % h->capacity].value = value;
-            return res;
-        }
+    uint64_t x = _mix(h->hash_func(key));
+    struct _table* t;
+    unsigned char* slot = _find(h, key, x, NULL, NULL, &t);
+    if (slot) {
+        struct hashtbl_element res = _element(h, slot);
+        // the previous key is overwritten by the new one when keys are inline
+        if (!h->inline_keys)
+            _set_slot(h, slot, key, value);
+        else
+            memcpy(slot + h->key_size, &value, sizeof(value));
+        return res;
     }
-    h->data[h2 % h->capacity] = (struct hashtbl_data){
-        .state = OCCUPED,
-        .key = key,
-        .hash_value = hash,
-        .value = value,
-    };
-    (h->nb_free_nodes)--;
+    if (!_insert(h, key, value, x))
+        return (struct hashtbl_element){ .key = ERROR_PTR, .value = ERROR_PTR };
     return (struct hashtbl_element) { .key = NULL, .value = NULL };
 }
 
 bool hashtbl_update_with_func(struct hashtbl* h, void* key, struct hashtbl_element (*update_func)(struct hashtbl_element elm, void* args), void* extra_args) {
-    if (!hashtbl_expand(h))
-        return false;
-    size_t hash = h->hash_func(key);
-    size_t h2 = hash;
-    for (; h->data[h2 % h->capacity].state == OCCUPED; h2++) {
-        if (!h->cmp_func(key, h->data[h2 % h->capacity].key)) {
-            struct hashtbl_element elm = update_func((struct hashtbl_element){
-                    .key = h->data[h2 % h->capacity].key,
-                    .value = h->data[h2 % h->capacity].value,
-                }, extra_args);
-            h->data[h2 % h->capacity].key = elm.key;
-            h->data[h2 % h->capacity].value = elm.value;
-            return true;
-        }
-    }
-    for (size_t hh = h2, i = h2 - hash; h->data[hh % h->capacity].state != FREED && i < h->capacity; hh++, i++) {
-        if (h->data[hh % h->capacity].state == OCCUPED && !h->cmp_func(key, h->data[hh % h->capacity].key)) {
-            struct hashtbl_element elm = update_func((struct hashtbl_element){
-                    .key = h->data[hh % h->capacity].key,
-                    .value = h->data[hh % h->capacity].value,
-                }, extra_args);
-            h->data[hh % h->capacity].key = elm.key;
-            h->data[hh % h->capacity].value = elm.value;
-            return true;
-        }
+    uint64_t x = _mix(h->hash_func(key));
+    struct _table* t;
+    unsigned char* slot = _find(h, key, x, NULL, NULL, &t);
+    if (slot) {
+        struct hashtbl_element elm = update_func(_element(h, slot), extra_args);
+        _set_slot(h, slot, elm.key, elm.value);
+        return true;
     }
     struct hashtbl_element elm = update_func((struct hashtbl_element){ .key = NULL, .value = NULL }, extra_args);
-    h->data[h2 % h->capacity] = (struct hashtbl_data){
-        .state = OCCUPED,
-        .key = elm.key,
-        .hash_value = hash,
-        .value = elm.value,
-    };
-    (h->nb_free_nodes)--;
-    return true;
+    return _insert(h, elm.key, elm.value, x);
 }
 
 void hashtbl_destroy(struct hashtbl* h) {
-    free(h->data);
+    _free_table(&h->table);
+    _free_table(&h->old);
     free(h);
 }
 
 void hashtbl_forall(struct hashtbl* h, void (*func)(struct hashtbl_element elm, void* args), void* extra_args) {
-    for (size_t i = 0; i < h->capacity; i++) {
-        if (h->data[i].state == OCCUPED) {
-            func((struct hashtbl_element){
-                     .key = h->data[i].key,
-                     .value = h->data[i].value,
-                 }, extra_args);
+    struct _table* tables[] = { &h->old, &h->table };
+    for (size_t k = 0; k < 2; k++) {
+        struct _table* t = tables[k];
+        for (size_t i = 0; t->ctrl && i < t->capacity; i++) {
+            if (!(t->ctrl[i] & 0x80))
+                func(_element(h, _slot(h, t, i)), extra_args);
         }
     }
 }
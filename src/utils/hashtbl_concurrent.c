@@ -0,0 +1,102 @@
+#define _POSIX_C_SOURCE 200809L
+#include "hashtbl_concurrent.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// one cache line per stripe: threads locking neighbouring stripes do not share it
+struct _stripe {
+    pthread_mutex_t lock;
+    struct hashtbl* table;
+} __attribute__((aligned(64)));
+
+struct hashtbl_concurrent {
+    struct _stripe* stripes;
+    size_t nb_stripes;
+    size_t (*hash_func)(const void* key);
+};
+
+struct hashtbl_concurrent* hashtbl_concurrent_new(size_t nb_stripes, size_t sizeof_key, size_t sizeof_value, struct hashtbl_creation_args* extra_args) {
+    struct hashtbl_concurrent* h = malloc(sizeof(*h));
+    if (!h) return NULL;
+    h->nb_stripes = 1;
+    while (h->nb_stripes < nb_stripes && h->nb_stripes <= SIZE_MAX / 2)
+        h->nb_stripes *= 2;
+    h->hash_func = extra_args->hash_func;
+    // aligned_alloc is C11
+    void* stripes = NULL;
+    if (posix_memalign(&stripes, 64, h->nb_stripes * sizeof(struct _stripe))) {
+        free(h);
+        return NULL;
+    }
+    h->stripes = stripes;
+    for (size_t i = 0; i < h->nb_stripes; i++) {
+        if (!(h->stripes[i].table = hashtbl_new(sizeof_key, sizeof_value, extra_args))) {
+            while (i--) {
+                hashtbl_destroy(h->stripes[i].table);
+                pthread_mutex_destroy(&h->stripes[i].lock);
+            }
+            free(h->stripes);
+            free(h);
+            return NULL;
+        }
+        pthread_mutex_init(&h->stripes[i].lock, NULL);
+    }
+    return h;
+}
+
+void hashtbl_concurrent_destroy(struct hashtbl_concurrent* h) {
+    for (size_t i = 0; i < h->nb_stripes; i++) {
+        hashtbl_destroy(h->stripes[i].table);
+        pthread_mutex_destroy(&h->stripes[i].lock);
+    }
+    free(h->stripes);
+    free(h);
+}
+
+size_t hashtbl_concurrent_stripe(struct hashtbl_concurrent* h, const void* key) {
+    if (h->nb_stripes == 1)
+        return 0;
+    // the bits which place the key in the table of its stripe are a product of the hash by an odd
+    // constant: take the stripe from the finalizer of murmur3 instead, so they are independent
+    uint64_t x = (uint64_t) h->hash_func(key);
+    x = (x ^ (x >> 33)) * 0xff51afd7ed558ccdull;
+    x = (x ^ (x >> 33)) * 0xc4ceb9fe1a85ec53ull;
+    return (size_t)(x ^ (x >> 33)) & (h->nb_stripes - 1);
+}
+
+void hashtbl_concurrent_lock(struct hashtbl_concurrent* h, size_t stripe) {
+    pthread_mutex_lock(&h->stripes[stripe].lock);
+}
+
+void hashtbl_concurrent_unlock(struct hashtbl_concurrent* h, size_t stripe) {
+    pthread_mutex_unlock(&h->stripes[stripe].lock);
+}
+
+struct hashtbl* hashtbl_concurrent_table(struct hashtbl_concurrent* h, size_t stripe) {
+    return h->stripes[stripe].table;
+}
+
+struct hashtbl_element hashtbl_concurrent_find(struct hashtbl_concurrent* h, void* key) {
+    struct _stripe* s = &h->stripes[hashtbl_concurrent_stripe(h, key)];
+    pthread_mutex_lock(&s->lock);
+    struct hashtbl_element e = hashtbl_find(s->table, key);
+    pthread_mutex_unlock(&s->lock);
+    return e;
+}
+
+struct hashtbl_element hashtbl_concurrent_add_if_absent(struct hashtbl_concurrent* h, void* key, void* value) {
+    struct _stripe* s = &h->stripes[hashtbl_concurrent_stripe(h, key)];
+    pthread_mutex_lock(&s->lock);
+    struct hashtbl_element e = hashtbl_find(s->table, key);
+    if (!e.value && !e.key && !hashtbl_add(s->table, key, value, false))
+        e = (struct hashtbl_element){ .key = ERROR_PTR, .value = ERROR_PTR };
+    pthread_mutex_unlock(&s->lock);
+    return e;
+}
+
+void hashtbl_concurrent_forall(struct hashtbl_concurrent* h, void (*func)(struct hashtbl_element elm, void* args), void* extra_args) {
+    for (size_t i = 0; i < h->nb_stripes; i++)
+        hashtbl_forall(h->stripes[i].table, func, extra_args);
+}
@@ -209,6 +209,22 @@ void* vector_pop(struct vector* v) {
     return ((char*)v->array) + (--(v->length)) * v->sizeof_elm;
 }
 
+/**
+ * @brief Removes all the elements of the vector.
+ *
+ * This function sets the length of the vector to 0 without releasing its storage,
+ * so the vector can be refilled without any reallocation up to its current capacity.
+ *
+ * @param v Pointer to the vector instance. Must not be NULL.
+ * @warning Passing a NULL pointer to this function will result in undefined behavior.
+ * @warning This function does not free the memory of elements pushed into the vector.
+ *
+ * @see vector_pop
+ */
+void vector_clear(struct vector* v) {
+    v->length = 0;
+}
+
 /**
  * @brief Checks if the vector is empty.
  *